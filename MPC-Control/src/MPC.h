@@ -3,21 +3,78 @@
 
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "mpc_model.h"
 
 using namespace std;
 
+// Outcome of the last MPC::Solve call.
+struct MPCSolveStats {
+  bool success;     // The backend converged or stopped at a usable solution
+  bool warm;        // Started from the shifted previous solution
+  int iterations;   // Ipopt iterations, or SQP iterations of the QP backend
+  double solve_ms;  // Wall time of the solve [ms]
+  double cost;      // Objective at the returned solution
+};
+
+// Optimizer behind MPC::Solve (mpc_backend.h)
+class MPCBackend;
+
+enum MPCSolverType {
+  MPC_SOLVER_IPOPT,  // Interior point on the nonlinear problem (mpc_ipopt.h)
+  MPC_SOLVER_QP      // Real-time sequential QP (mpc_qp.h)
+};
+
+//
+// Controller over a horizon of N look ahead steps of DtMs milliseconds.
+// Defined in MPC.cpp for the horizons of MPC_HORIZONS (mpc_model.h).
+//
+template <int N, int DtMs = 100>
 class MPC {
  public:
   MPC();
+  MPC(const MPC&) = delete;
+  MPC& operator=(const MPC&) = delete;
 
   double prev_delta = 0;
   double prev_a = 0;
 
+  // Start each solve from the previous solution shifted by one step
+  bool warm_start = true;
+
+  // Backend to solve with. Takes effect if set before the first solve. Builds
+  // without Ipopt (MPC_IPOPT undefined) always use the QP backend.
+  MPCSolverType solver_type = MPC_SOLVER_IPOPT;
+
+  // Hand Ipopt the closed-form derivatives of FG_analytic instead of those of
+  // a CppAD tape. Takes effect if set before the first solve.
+  bool analytic_derivatives = false;
+
+  // Weights and references of the cost, read on every solve
+  MPCWeights weights;
+
   virtual ~MPC();
 
   // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuatotions.
+  // Return the first actuatotions, then the predicted x, y of steps 1 .. N-1.
   vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+
+  // Forget the previous solution, the next solve starts cold.
+  void Reset();
+
+  const MPCSolveStats& LastSolve() const { return stats; }
+
+  // All variables of the last solve, in the layout of mpc_model.h
+  const vector<double>& LastSolution() const { return vars; }
+
+ private:
+  // Optimal variables of the previous solve, empty until a solve succeeded
+  vector<double> prev_vars;
+  vector<double> vars;
+
+  MPCSolveStats stats;
+
+  // Created by the first solve
+  MPCBackend* backend;
 };
 
 #endif /* MPC_H */
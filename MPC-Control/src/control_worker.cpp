@@ -0,0 +1,48 @@
+#include "control_worker.h"
+
+ControlWorker::ControlWorker(Handler handler)
+    : handler(handler), pending(false), stopping(false) {
+  thread = std::thread(&ControlWorker::run, this);
+}
+
+ControlWorker::~ControlWorker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+bool ControlWorker::Submit(ControlRequest& request) {
+  bool replaced;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    replaced = pending;
+    // Swapping hands the waypoint buffers back and forth instead of copying
+    std::swap(next.telemetry, request.telemetry);
+    next.received = request.received;
+    next.connection = request.connection;
+    pending = true;
+  }
+  wake.notify_one();
+  return !replaced;
+}
+
+void ControlWorker::run() {
+  ControlRequest current;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this]() { return pending || stopping; });
+      if (stopping) {
+        return;
+      }
+      std::swap(current.telemetry, next.telemetry);
+      current.received = next.received;
+      current.connection = next.connection;
+      pending = false;
+    }
+    handler(current);
+  }
+}
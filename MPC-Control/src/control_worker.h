@@ -0,0 +1,56 @@
+#ifndef CONTROL_WORKER_H
+#define CONTROL_WORKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "telemetry.h"
+
+// Telemetry event for the controller and when it arrived
+struct ControlRequest {
+  Telemetry telemetry;
+  std::chrono::steady_clock::time_point received;
+  // Identifies the connection to reply on, for the handler
+  int connection;
+};
+
+//
+// Runs the controller on a thread of its own, so the socket thread keeps
+// reading telemetry while a solve is in progress. There is a single slot for
+// the next event: an event that arrives while another one still waits
+// replaces it, so the controller always works on the newest telemetry and
+// never falls behind.
+//
+class ControlWorker {
+ public:
+  // May change the request, which is only reused for a later event
+  typedef std::function<void(ControlRequest&)> Handler;
+
+  // Starts the thread, which calls handler for every event taken up
+  explicit ControlWorker(Handler handler);
+  ControlWorker(const ControlWorker&) = delete;
+  ControlWorker& operator=(const ControlWorker&) = delete;
+
+  // Stops the thread after the event in progress
+  ~ControlWorker();
+
+  // Hands an event to the worker; its telemetry is swapped out of request.
+  // Returns false if it replaced an event that was still waiting.
+  bool Submit(ControlRequest& request);
+
+ private:
+  void run();
+
+  Handler handler;
+  std::mutex mutex;
+  std::condition_variable wake;
+  ControlRequest next;
+  bool pending;
+  bool stopping;
+  std::thread thread;
+};
+
+#endif /* CONTROL_WORKER_H */
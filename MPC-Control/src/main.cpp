@@ -1,15 +1,21 @@
 #include <math.h>
 #include <uWS/uWS.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <vector>
-#include <cppad/cppad.hpp>
-#include <cppad/ipopt/solve.hpp>
 #include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
 #include "MPC.h"
+#include "control_worker.h"
 #include "json.hpp"
+#include "simulator.h"
+#include "telemetry.h"
 
 // for convenience
 using json = nlohmann::json;
@@ -34,167 +40,243 @@ string hasData(string s) {
   return "";
 }
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
+// Command of one control cycle, sent once its deadline has passed
+struct Reply {
+  std::chrono::steady_clock::time_point deadline;
+  int connection;
+  std::string msg;
+};
+
+// Replies handed from the control worker to the socket thread
+struct ReplyQueue {
+  std::mutex mutex;
+  std::vector<Reply> posted;
+  // The rest is only touched on the socket thread: the replies waiting for
+  // their deadlines, earliest first, the timer that sends them, and the
+  // connection they go to (0 for none)
+  std::deque<Reply> waiting;
+  uS::Timer *timer;
+  uWS::WebSocket<uWS::SERVER> socket;
+  int connection = 0;
+};
+
+// Sends the waiting replies that are due and sets the timer for the next one
+static void sendDue(uS::Timer *timer) {
+  ReplyQueue *replies = static_cast<ReplyQueue *>(timer->getData());
+  // The timer has millisecond resolution
+  auto now = std::chrono::steady_clock::now() + std::chrono::microseconds(500);
+  while (!replies->waiting.empty() && replies->waiting.front().deadline <= now) {
+    const Reply &reply = replies->waiting.front();
+    if (reply.connection == replies->connection) {
+      replies->socket.send(reply.msg.data(), reply.msg.length(), uWS::OpCode::TEXT);
+    }
+    replies->waiting.pop_front();
   }
-  return result;
-}
-
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
-
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
+  if (!replies->waiting.empty()) {
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        replies->waiting.front().deadline - now);
+    // uWS's epoll loop adds a second timeout instead of moving a pending one
+    timer->stop();
+    timer->start(sendDue, std::max(1, int(wait.count()) + 1), 0);
   }
+}
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+// Runs on the socket thread whenever the control worker has posted replies
+static void takeReplies(uS::Async *async) {
+  ReplyQueue *replies = static_cast<ReplyQueue *>(async->getData());
+  {
+    std::lock_guard<std::mutex> lock(replies->mutex);
+    for (size_t i = 0; i < replies->posted.size(); i++) {
+      Reply &reply = replies->posted[i];
+      auto later = std::upper_bound(
+          replies->waiting.begin(), replies->waiting.end(), reply,
+          [](const Reply &a, const Reply &b) { return a.deadline < b.deadline; });
+      replies->waiting.insert(later, std::move(reply));
     }
+    replies->posted.clear();
   }
-
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
+  sendDue(replies->timer);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
   uWS::Hub h;
 
   // MPC is initialized here!
-  MPC mpc;
+  MPC<10> mpc;
+
+  // --record FILE appends every telemetry event to FILE, one per line, for
+  // mpc_benchmark to replay. --qp solves with the real-time QP backend
+  // instead of Ipopt. --track FILE takes the reference from the spline of
+  // the track in FILE, e.g. ../lake_track_waypoints.csv, instead of from the
+  // waypoints in the telemetry. --latency MS is the actuation latency to
+  // drive with, 100 ms by default. --verbose prints the solve of every cycle.
+  std::ofstream record;
+  Track track;
+  // Arc length of the vehicle along the track at the last event, and the
+  // connection the event came from
+  double track_s = -1;
+  int track_connection = 0;
+  double actuation_latency = 0.1;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--qp") == 0) {
+      mpc.solver_type = MPC_SOLVER_QP;
+    }
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record.open(argv[i + 1], std::ios::app);
+      if (!record) {
+        std::cerr << "Failed to open " << argv[i + 1] << std::endl;
+        return -1;
+      }
+    }
+    if (strcmp(argv[i], "--track") == 0 && i + 1 < argc &&
+        !track.Load(argv[i + 1])) {
+      std::cerr << "Failed to load track " << argv[i + 1] << std::endl;
+      return -1;
+    }
+    if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      actuation_latency = atof(argv[i + 1]) / 1000;
+    }
+    if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    }
+  }
+
+  // Telemetry is read on the socket thread and solved on the control
+  // worker. The commands come back through an async wake-up of the socket
+  // loop, and a timer sends each one when the actuation latency after its
+  // telemetry has passed. Nothing on the socket thread waits for a solve or
+  // for the latency.
+  ReplyQueue replies;
+  uS::Async *async = new uS::Async(h.getLoop());
+  async->setData(&replies);
+  async->start(takeReplies);
+  replies.timer = new uS::Timer(h.getLoop());
+  replies.timer->setData(&replies);
+
+  // Running average of the time from taking up an event to its reply [s]
+  double solve_time = 0.01;
+
+  ControlWorker worker([&](ControlRequest &request) {
+    Telemetry &telemetry = request.telemetry;
+    auto start = std::chrono::steady_clock::now();
+    if (track.Size() > 0) {
+      // A new connection is a new run, which may start anywhere on the track
+      if (request.connection != track_connection) {
+        track_s = -1;
+        track_connection = request.connection;
+      }
+      splineWaypoints(track.spline, 1.5, track_s, telemetry);
+    }
+
+    // The command takes effect when the timer sends it, the actuation latency
+    // after the telemetry arrived. When the measured wait for the worker and
+    // the usual solve time do not fit in that, it is sent as soon as it is
+    // solved instead, that much later.
+    double queued =
+        std::chrono::duration<double>(start - request.received).count();
+    double latency = std::max(actuation_latency, queued + solve_time);
+
+    // Car frame waypoints, their fit and the state predicted to the moment
+    // the command takes effect
+    ControlInput input;
+    prepareControlInput(telemetry, mpc.prev_a, latency, input);
+
+    // Solve using MPC
+    // coeffs to predict future cte and epsi
+    auto result = mpc.Solve(input.state, input.coeffs);
+    double steer_value = result[0]/ (deg2rad(25)*Lf);
+    // A console write per cycle is flushed line by line on a terminal and
+    // can hold up the worker, so it is only done on request
+    if (verbose) {
+      const MPCSolveStats &stats = mpc.LastSolve();
+      std::cout << "Cost " << stats.cost << " iterations " << stats.iterations
+                << (stats.warm ? " (warm) " : " (cold) ") << stats.solve_ms
+                << " ms, latency " << latency * 1000 << " ms, steer_value "
+                << steer_value << '\n';
+    }
+    double throttle_value = result[1];
+
+    mpc.prev_a = throttle_value;
+
+    json msgJson;
+    msgJson["steering_angle"] = steer_value;
+    msgJson["throttle"] = throttle_value;
 
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, int length,
+    //Display the MPC predicted trajectory
+    vector<double> mpc_x_vals;
+    vector<double> mpc_y_vals;
+
+    //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+    // the points in the simulator are connected by a Green line
+    // std::cout << "result size: " << result.size() << endl;
+    for (int i = 2; i < int(result.size()); i++) {
+      if(i%2 == 0){
+        mpc_x_vals.push_back(result[i]);
+      } else {
+        mpc_y_vals.push_back(result[i]);
+      }
+    }
+
+    msgJson["mpc_x"] = mpc_x_vals;
+    msgJson["mpc_y"] = mpc_y_vals;
+
+    //Display the waypoints/reference line
+    vector<double> next_x_vals;
+    vector<double> next_y_vals;
+
+    //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+    // the points in the simulator are connected by a Yellow line
+    next_x_vals = input.ptsx;
+    next_y_vals = input.ptsy;
+
+    msgJson["next_x"] = next_x_vals;
+    msgJson["next_y"] = next_y_vals;
+
+    Reply reply;
+    reply.msg = "42[\"steer\"," + msgJson.dump() + "]";
+    reply.connection = request.connection;
+    reply.deadline = request.received +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(latency));
+
+    auto end = std::chrono::steady_clock::now();
+    solve_time = 0.9 * solve_time +
+                 0.1 * std::chrono::duration<double>(end - start).count();
+    {
+      std::lock_guard<std::mutex> lock(replies.mutex);
+      replies.posted.push_back(std::move(reply));
+    }
+    async->send();
+  });
+
+  // Decoded telemetry, its buffers are swapped with the worker's on submit
+  ControlRequest request;
+
+  h.onMessage([&worker,&replies,&record,&request](uWS::WebSocket<uWS::SERVER> ws, char *data, int length,
                      uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
+    auto received = std::chrono::steady_clock::now();
     string sdata = string(data).substr(0, length);
-    cout << sdata << endl;
     if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
       string s = hasData(sdata);
       if (s != "") {
         auto j = json::parse(s);
         string event = j[0].get<string>();
         if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
-
-          //transform to car coordinates (frame)
-          for (int i = 0; i < int(ptsx.size()); i++) {
-            double dtx = ptsx[i] - px;
-            double dty = ptsy[i] - py;
-
-            ptsx[i] = dtx * cos(psi) + dty * sin(psi);
-            ptsy[i] = dty * cos(psi) - dtx * sin(psi);
-          }
-
-          // ptsx and ptsy data into vectors
-          Eigen::VectorXd ptsxvec = Eigen::VectorXd::Map(ptsx.data(), ptsx.size());
-          Eigen::VectorXd ptsyvec = Eigen::VectorXd::Map(ptsy.data(), ptsy.size());
-
-          // Fit polynomial to x and y coordinates
-          auto coeffs = polyfit(ptsxvec, ptsyvec, 3);
-
-          // Estimate cross-track error
-          double cte = polyeval(coeffs, 0);
-          // Calculate orientation error
-          double epsi = -atan(coeffs[1]);
-
-          Eigen::VectorXd state(6);
-
-          const double Lf = 2.67;
-          double dt = 0.1;
-          // Previous steering angle and throttle
-          double delta = j[1]["steering_angle"];
-          double prev_a = mpc.prev_a;
-
-          // Predict (x = y = psi = 0)
-          double predicted_x = v * dt;
-          double predicted_y = 0;
-          double predicted_psi = - v * delta / Lf * dt;
-          double predicted_v = v + prev_a * dt;
-          double predicted_cte = cte + v * CppAD::sin(epsi) * dt;
-          double predicted_epsi = epsi + predicted_psi;
-
-          state << predicted_x, predicted_y, predicted_psi, predicted_v, predicted_cte, predicted_epsi;
-
-          // Solve using MPC
-          // coeffs to predict future cte and epsi
-          auto result = mpc.Solve(state, coeffs);
-
-          double steer_value = result[0]/ (deg2rad(25)*Lf);
-          std::cout << "steer_value: " << steer_value << endl;
-          double throttle_value = result[1];
-
-          mpc.prev_a = throttle_value;
-
-          json msgJson;
-          msgJson["steering_angle"] = steer_value;
-          msgJson["throttle"] = throttle_value;
-
-          //Display the MPC predicted trajectory
-          vector<double> mpc_x_vals;
-          vector<double> mpc_y_vals;
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-          // std::cout << "result size: " << result.size() << endl;
-          for (int i = 2; i < int(result.size()); i++) {
-            if(i%2 == 0){
-              mpc_x_vals.push_back(result[i]);
-            } else {
-              mpc_y_vals.push_back(result[i]);
-            }
+          if (record.is_open()) {
+            record << s << std::endl;
           }
 
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
-
-          //Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
-
-          next_x_vals.resize(ptsxvec.size());
-          next_y_vals.resize(ptsyvec.size());
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-          for (int i = 0; i < ptsxvec.size(); i++) {
-            next_x_vals[i] = ptsxvec[i];
-            next_y_vals[i] = ptsyvec[i];
+          // j[1] is the data JSON object
+          parseTelemetry(j[1], request.telemetry);
+          request.received = received;
+          request.connection = replies.connection;
+          if (!worker.Submit(request)) {
+            std::cerr << "Controller busy, skipping older telemetry" << std::endl;
           }
-
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
         }
       } else {
         // Manual driving
@@ -218,12 +300,20 @@ int main() {
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  // Replies go to the latest connection; those solved for an earlier one
+  // are dropped
+  int connections = 0;
+  h.onConnection([&replies,&connections](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    replies.socket = ws;
+    replies.connection = ++connections;
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, int length) {
+  h.onDisconnection([&replies](uWS::WebSocket<uWS::SERVER> ws, int code,
+                               char *message, int length) {
+    if (replies.connection != 0 && replies.socket == ws) {
+      replies.connection = 0;
+    }
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
@@ -0,0 +1,28 @@
+#ifndef MPC_BACKEND_H
+#define MPC_BACKEND_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "mpc_model.h"
+
+//
+// Optimizer behind MPC::Solve. The variables follow the layout of
+// mpc_model.h; MPC sets the initial state at step 0 and a starting guess for
+// everything else, and the backend replaces them with its solution.
+//
+class MPCBackend {
+ public:
+  virtual ~MPCBackend() {}
+
+  // @param coeffs Polynomial coefficients of the reference line
+  // @param weights Weights and references of the cost
+  // @param warm The guess is the previous solution shifted by one step
+  // @param vars Initial state and starting guess in, solution out
+  // @param stats Receives success, iterations and cost
+  virtual void Solve(const Eigen::VectorXd& coeffs, const MPCWeights& weights,
+                     bool warm, std::vector<double>& vars,
+                     MPCSolveStats& stats) = 0;
+};
+
+#endif /* MPC_BACKEND_H */
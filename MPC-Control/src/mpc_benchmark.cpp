@@ -0,0 +1,412 @@
+// Replays telemetry recorded with `mpc --record FILE` through the controller
+// without the simulator and reports solver iterations and solve latency per
+// control cycle, with and without warm starting, for Ipopt and the QP backend
+// and for horizons of 5, 10 and 20 steps.
+// Also compares the cost the two backends reach on the same problems, the
+// tape kept for all solves with one recorded per solve, and the cost of
+// evaluating the problem derivatives from the CppAD tape and from
+// FG_analytic. The fit of the reference polynomial is timed by mpc_microbench.
+//
+// Usage: mpc_benchmark FILE
+//        mpc_benchmark --track TRACK
+//
+// With --track the events are those of a lap of TRACK, e.g.
+// ../lake_track_waypoints.csv, in the offline closed loop of simulator.h,
+// driven by the QP backend, so no recording from the simulator is needed.
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MPC.h"
+#include "json.hpp"
+#include "mpc_model.h"
+#include "mpc_nlp.h"
+#include "simulator.h"
+#include "telemetry.h"
+
+// for convenience
+using json = nlohmann::json;
+
+// Runs the recorded events through a fresh controller, feeding its throttle
+// back like main.cpp does, and prints one line of statistics.
+template <int N>
+static void replay(const vector<Telemetry> &events, bool warm_start,
+                   MPCSolverType solver_type, bool analytic) {
+  MPC<N> mpc;
+  mpc.warm_start = warm_start;
+  mpc.solver_type = solver_type;
+  mpc.analytic_derivatives = analytic;
+
+  vector<double> latency;
+  vector<double> iterations;
+  double cost = 0;
+  int failed = 0;
+  ControlInput input;
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], mpc.prev_a, 0.1, input);
+    vector<double> result = mpc.Solve(input.state, input.coeffs);
+    mpc.prev_a = result[1];
+
+    const MPCSolveStats &stats = mpc.LastSolve();
+    latency.push_back(stats.solve_ms);
+    iterations.push_back(stats.iterations);
+    cost += stats.cost;
+    failed += stats.success ? 0 : 1;
+  }
+
+  double mean_latency = 0;
+  double mean_iterations = 0;
+  for (size_t k = 0; k < latency.size(); k++) {
+    mean_latency += latency[k] / latency.size();
+    mean_iterations += iterations[k] / iterations.size();
+  }
+  std::sort(latency.begin(), latency.end());
+  std::sort(iterations.begin(), iterations.end());
+
+  const char *backend = solver_type == MPC_SOLVER_QP ? "qp"
+                        : analytic ? "ipopt-analytic" : "ipopt-tape";
+  printf("%3d %-5s %-14s %7zu %7d %9.1f %9.0f %9.0f %9.2f %9.2f %9.2f %9.2f %12.1f\n",
+         N, warm_start ? "warm" : "cold", backend,
+         events.size(), failed, mean_iterations,
+         percentile(iterations, 0.5), iterations.empty() ? 0 : iterations.back(),
+         mean_latency, percentile(latency, 0.5), percentile(latency, 0.99),
+         latency.empty() ? 0 : latency.back(),
+         events.empty() ? 0 : cost / events.size());
+}
+
+// Solves the problem of every recorded event with both backends, warm started
+// and fed the Ipopt throttle, and reports how far the QP backend's cost is
+// above Ipopt's and how much its first actuations differ.
+static void compareBackends(const vector<Telemetry> &events) {
+  MPC<10> ipopt;
+  ipopt.analytic_derivatives = true;
+  MPC<10> qp;
+  qp.solver_type = MPC_SOLVER_QP;
+
+  vector<double> excess;
+  double max_delta_difference = 0;
+  double max_a_difference = 0;
+  ControlInput input;
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], ipopt.prev_a, 0.1, input);
+    vector<double> reference = ipopt.Solve(input.state, input.coeffs);
+    vector<double> result = qp.Solve(input.state, input.coeffs);
+    ipopt.prev_a = reference[1];
+    if (!ipopt.LastSolve().success) {
+      continue;
+    }
+
+    double cost = ipopt.LastSolve().cost;
+    excess.push_back((qp.LastSolve().cost - cost) / std::max(fabs(cost), 1e-9));
+    max_delta_difference = std::max(max_delta_difference, fabs(result[0] - reference[0]));
+    max_a_difference = std::max(max_a_difference, fabs(result[1] - reference[1]));
+  }
+  std::sort(excess.begin(), excess.end());
+
+  printf("\nQP backend against Ipopt on the same problems, %zu cycles\n", excess.size());
+  printf("relative cost excess: p50 %.2e, p99 %.2e, max %.2e\n",
+         percentile(excess, 0.5), percentile(excess, 0.99),
+         excess.empty() ? 0 : excess.back());
+  printf("max first actuation difference: delta %.4f, a %.4f\n",
+         max_delta_difference, max_a_difference);
+}
+
+// Solves the problem of every event cold, once with a controller that keeps
+// its CppAD tape, sparsity patterns and Ipopt instance across solves and once
+// with a new controller per event, which records a new tape and sets up Ipopt
+// as every solve did before they were kept. Reports how far the solutions
+// differ and the time per cycle of each, the new controller included.
+static void compareRetaping(const vector<Telemetry> &events) {
+  MPC<10> kept;
+  kept.warm_start = false;
+
+  vector<double> kept_ms;
+  vector<double> retaped_ms;
+  double max_vars_difference = 0;
+  double max_cost_difference = 0;
+  int same_iterations = 0;
+  int compared = 0;
+  ControlInput input;
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], kept.prev_a, 0.1, input);
+
+    auto start = std::chrono::steady_clock::now();
+    vector<double> result = kept.Solve(input.state, input.coeffs);
+    auto kept_end = std::chrono::steady_clock::now();
+    MPC<10> fresh;
+    fresh.warm_start = false;
+    fresh.Solve(input.state, input.coeffs);
+    auto fresh_end = std::chrono::steady_clock::now();
+    kept.prev_a = result[1];
+
+    kept_ms.push_back(
+        std::chrono::duration<double, std::milli>(kept_end - start).count());
+    retaped_ms.push_back(std::chrono::duration<double, std::milli>(
+                             fresh_end - kept_end).count());
+    if (!kept.LastSolve().success || !fresh.LastSolve().success) {
+      continue;
+    }
+    compared++;
+    const vector<double> &a = kept.LastSolution();
+    const vector<double> &b = fresh.LastSolution();
+    for (size_t i = 0; i < a.size(); i++) {
+      max_vars_difference = std::max(max_vars_difference, fabs(a[i] - b[i]));
+    }
+    max_cost_difference =
+        std::max(max_cost_difference,
+                 fabs(kept.LastSolve().cost - fresh.LastSolve().cost));
+    same_iterations +=
+        kept.LastSolve().iterations == fresh.LastSolve().iterations ? 1 : 0;
+  }
+  std::sort(kept_ms.begin(), kept_ms.end());
+  std::sort(retaped_ms.begin(), retaped_ms.end());
+
+  printf("\nTape kept against a tape per solve, cold, %zu cycles, %d both "
+         "succeeded\n", events.size(), compared);
+  printf("%-9s %9s %9s %9s\n", "tape", "ms_p50", "ms_p99", "ms_max");
+  printf("%-9s %9.3f %9.3f %9.3f\n", "kept", percentile(kept_ms, 0.5),
+         percentile(kept_ms, 0.99), kept_ms.back());
+  printf("%-9s %9.3f %9.3f %9.3f\n", "per-solve", percentile(retaped_ms, 0.5),
+         percentile(retaped_ms, 0.99), retaped_ms.back());
+  printf("max difference: variables %.3g, cost %.3g; same iteration count in "
+         "%d of %d\n", max_vars_difference, max_cost_difference,
+         same_iterations, compared);
+}
+
+// Sparse triplets as a map, so values in different orders can be compared
+static std::map<std::pair<int, int>, double> triplets(const vector<int> &row,
+                                                      const vector<int> &col,
+                                                      const vector<double> &values) {
+  std::map<std::pair<int, int>, double> entries;
+  for (size_t k = 0; k < values.size(); k++) {
+    entries[std::make_pair(row[k], col[k])] += values[k];
+  }
+  return entries;
+}
+
+static double maxDifference(const std::map<std::pair<int, int>, double> &a,
+                            const std::map<std::pair<int, int>, double> &b) {
+  double difference = 0;
+  for (auto entry = a.begin(); entry != a.end(); ++entry) {
+    auto other = b.find(entry->first);
+    double value = other == b.end() ? 0 : other->second;
+    difference = std::max(difference, fabs(entry->second - value));
+  }
+  for (auto entry = b.begin(); entry != b.end(); ++entry) {
+    if (a.find(entry->first) == a.end()) {
+      difference = std::max(difference, fabs(entry->second));
+    }
+  }
+  return difference;
+}
+
+// Derivatives Ipopt asks for in one iteration, from one problem
+struct Derivatives {
+  vector<double> grad;
+  vector<int> jac_row;
+  vector<int> jac_col;
+  vector<double> jac;
+  vector<int> hes_row;
+  vector<int> hes_col;
+  vector<double> hes;
+};
+
+// Evaluates cost, gradient, constraints, Jacobian and Hessian of the
+// Lagrangian at every point, as Ipopt does once per iteration, and returns
+// the time per point [us].
+template <int N>
+static double evaluateDerivatives(FG_nlp<N> &nlp, const vector<vector<double> > &params,
+                                  const vector<vector<double> > &points,
+                                  const vector<double> &lambda,
+                                  vector<Derivatives> &results) {
+  Ipopt::Index n, m, nnz_jac, nnz_hes;
+  Ipopt::TNLP::IndexStyleEnum style;
+  nlp.get_nlp_info(n, m, nnz_jac, nnz_hes, style);
+  results.resize(points.size());
+  vector<double> g(m);
+  for (size_t k = 0; k < points.size(); k++) {
+    Derivatives &d = results[k];
+    d.grad.resize(n);
+    d.jac_row.resize(nnz_jac);
+    d.jac_col.resize(nnz_jac);
+    d.jac.resize(nnz_jac);
+    d.hes_row.resize(nnz_hes);
+    d.hes_col.resize(nnz_hes);
+    d.hes.resize(nnz_hes);
+    nlp.eval_jac_g(n, NULL, false, m, nnz_jac, d.jac_row.data(), d.jac_col.data(), NULL);
+    nlp.eval_h(n, NULL, false, 1, m, NULL, false, nnz_hes, d.hes_row.data(), d.hes_col.data(), NULL);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t k = 0; k < points.size(); k++) {
+    Derivatives &d = results[k];
+    const double *x = points[k].data();
+    double f;
+    nlp.SetParams(params[k].data(), MPCWeights());
+    nlp.Prepare();
+    nlp.eval_f(n, x, true, f);
+    nlp.eval_g(n, x, false, m, g.data());
+    nlp.eval_grad_f(n, x, false, d.grad.data());
+    nlp.eval_jac_g(n, x, false, m, nnz_jac, NULL, NULL, d.jac.data());
+    nlp.eval_h(n, x, false, 1, m, lambda.data(), true, nnz_hes, NULL, NULL, d.hes.data());
+  }
+  double elapsed = std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count();
+  return elapsed / points.size();
+}
+
+// Times the derivatives of the problem of each recorded event, at the
+// trajectory its initial state leads to under a mild turn and throttle, from
+// the tape and from FG_analytic, and checks that they agree.
+template <int N>
+static void benchmarkDerivatives(const vector<Telemetry> &events) {
+  typedef MPCLayout<N> Layout;
+  int n_vars = Layout::n_vars;
+  int n_constraints = Layout::n_constraints;
+  FG_nlp<N> tape(false);
+  FG_nlp<N> analytic(true);
+
+  vector<vector<double> > params;
+  vector<vector<double> > points;
+  ControlInput input;
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], 0, 0.1, input);
+    vector<double> vars(n_vars, 0.0);
+    vars[Layout::x_start] = input.state[0];
+    vars[Layout::y_start] = input.state[1];
+    vars[Layout::psi_start] = input.state[2];
+    vars[Layout::v_start] = input.state[3];
+    vars[Layout::cte_start] = input.state[4];
+    vars[Layout::epsi_start] = input.state[5];
+    for (int i = 0; i < N - 1; i++) {
+      vars[Layout::delta_start + i] = 0.05;
+      vars[Layout::a_start + i] = 0.5;
+    }
+    rollout<N, 100>(input.coeffs, vars);
+    points.push_back(vars);
+    params.push_back(vector<double>(input.coeffs.data(), input.coeffs.data() + 4));
+  }
+  vector<double> lambda(n_constraints);
+  for (int i = 0; i < n_constraints; i++) {
+    lambda[i] = 1.0 / (1 + i % N);
+  }
+
+  vector<Derivatives> tape_results;
+  vector<Derivatives> analytic_results;
+  // The first pass lets CppAD compute its colorings
+  evaluateDerivatives(tape, params, points, lambda, tape_results);
+  double tape_us = evaluateDerivatives(tape, params, points, lambda, tape_results);
+  double analytic_us = evaluateDerivatives(analytic, params, points, lambda, analytic_results);
+
+  double grad_error = 0;
+  double jac_error = 0;
+  double hes_error = 0;
+  for (size_t k = 0; k < points.size(); k++) {
+    const Derivatives &a = tape_results[k];
+    const Derivatives &b = analytic_results[k];
+    for (size_t j = 0; j < a.grad.size(); j++) {
+      grad_error = std::max(grad_error, fabs(a.grad[j] - b.grad[j]));
+    }
+    jac_error = std::max(jac_error, maxDifference(triplets(a.jac_row, a.jac_col, a.jac),
+                                                  triplets(b.jac_row, b.jac_col, b.jac)));
+    hes_error = std::max(hes_error, maxDifference(triplets(a.hes_row, a.hes_col, a.hes),
+                                                  triplets(b.hes_row, b.hes_col, b.hes)));
+  }
+
+  printf("\nDerivatives per Ipopt iteration (f, g, grad f, Jacobian, Hessian), %zu points\n",
+         points.size());
+  printf("%-9s %9s %9s %9s\n", "source", "us", "jac_nnz", "hes_nnz");
+  printf("%-9s %9.2f %9zu %9zu\n", "tape", tape_us, tape_results[0].jac.size(),
+         tape_results[0].hes.size());
+  printf("%-9s %9.2f %9zu %9zu\n", "analytic", analytic_us,
+         analytic_results[0].jac.size(), analytic_results[0].hes.size());
+  printf("max difference: gradient %.3g, Jacobian %.3g, Hessian %.3g\n",
+         grad_error, jac_error, hes_error);
+}
+
+// Reads a recording of `mpc --record`, one ["telemetry", {...}] event per
+// line
+static bool readRecording(const char *file, vector<Telemetry> &events) {
+  std::ifstream in(file);
+  if (!in) {
+    std::cerr << "Failed to open " << file << std::endl;
+    return false;
+  }
+  string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto j = json::parse(line);
+    if (j[0].get<string>() == "telemetry") {
+      events.push_back(Telemetry());
+      parseTelemetry(j[1], events.back());
+    }
+  }
+  return true;
+}
+
+// The events of a lap of the track in the offline closed loop
+static bool simulateLap(const char *file, vector<Telemetry> &events) {
+  Track track;
+  if (!track.Load(file)) {
+    std::cerr << "Failed to load track " << file << std::endl;
+    return false;
+  }
+  SimConfig cfg;
+  cfg.record_telemetry = true;
+  SimResult result;
+  MPC<10> mpc;
+  mpc.solver_type = MPC_SOLVER_QP;
+  simulate(track, cfg, mpc, result);
+  events.swap(result.telemetry);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  bool track = argc == 3 && strcmp(argv[1], "--track") == 0;
+  if (argc != 2 && !track) {
+    std::cerr << "Usage: " << argv[0] << " FILE | --track TRACK" << std::endl;
+    return -1;
+  }
+
+  vector<Telemetry> events;
+  const char *file = argv[argc - 1];
+  if (!(track ? simulateLap(file, events) : readRecording(file, events))) {
+    return -1;
+  }
+  if (events.empty()) {
+    std::cerr << "No telemetry in " << file << std::endl;
+    return -1;
+  }
+  printf("%zu events from %s %s\n\n", events.size(),
+         track ? "a simulated lap of" : "the recording", file);
+
+  printf("%3s %-5s %-14s %7s %7s %9s %9s %9s %9s %9s %9s %9s %12s\n", "N",
+         "start", "backend", "cycles", "failed", "iter_mean", "iter_p50", "iter_max",
+         "ms_mean", "ms_p50", "ms_p99", "ms_max", "cost_mean");
+  replay<10>(events, false, MPC_SOLVER_IPOPT, false);
+  replay<10>(events, true, MPC_SOLVER_IPOPT, false);
+  replay<10>(events, false, MPC_SOLVER_IPOPT, true);
+  replay<10>(events, true, MPC_SOLVER_IPOPT, true);
+  replay<10>(events, false, MPC_SOLVER_QP, false);
+  replay<10>(events, true, MPC_SOLVER_QP, false);
+
+  // Horizons side by side, warm started
+  replay<5>(events, true, MPC_SOLVER_IPOPT, true);
+  replay<20>(events, true, MPC_SOLVER_IPOPT, true);
+  replay<5>(events, true, MPC_SOLVER_QP, false);
+  replay<20>(events, true, MPC_SOLVER_QP, false);
+
+  compareBackends(events);
+  compareRetaping(events);
+  benchmarkDerivatives<10>(events);
+  return 0;
+}
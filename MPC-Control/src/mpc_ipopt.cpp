@@ -0,0 +1,125 @@
+#include "mpc_ipopt.h"
+#include <limits>
+#include "mpc_model.h"
+
+typedef std::vector<double> Dvector;
+
+template <int N, int DtMs>
+IpoptBackend<N, DtMs>::IpoptBackend(bool analytic_derivatives)
+    : fg_nlp(new FG_nlp<N, DtMs>(analytic_derivatives)), nlp(fg_nlp),
+      app(new Ipopt::IpoptApplication()), optimized(false) {
+  // options for IPOPT solver
+  app->Options()->SetIntegerValue("print_level", 0);
+  app->Options()->SetStringValue("sb", "yes");
+  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
+  // Change this as you see fit.
+  app->Options()->SetNumericValue("max_cpu_time", 0.5);
+  // Applied to warm starts only
+  app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+  app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  status = app->Initialize();
+
+  Dvector& vars_lowerbound = fg_nlp->vars_lowerbound;
+  Dvector& vars_upperbound = fg_nlp->vars_upperbound;
+
+  //Set lower and upper limits for variables.
+  for (int i = 0; i < Layout::delta_start; i++) {
+    vars_upperbound[i] = std::numeric_limits<double>::max();
+    vars_lowerbound[i] = std::numeric_limits<double>::lowest();
+  }
+
+  // Steering angle (deltas)
+  for (int i = Layout::delta_start; i < Layout::a_start; i++)
+  {
+    vars_upperbound[i] = max_delta;
+    vars_lowerbound[i] = -max_delta;
+  }
+
+  // Acceleration
+  for (int i = Layout::a_start; i < Layout::n_vars; i++)
+  {
+    vars_upperbound[i] = max_a;
+    vars_lowerbound[i] = -max_a;
+  }
+
+  // Lower and upper limits for the constraints
+  // Should be 0 besides initial state, which is set per solve.
+  for (int i = 0; i < Layout::n_constraints; i++) {
+    fg_nlp->constraints_lowerbound[i] = 0;
+    fg_nlp->constraints_upperbound[i] = 0;
+  }
+}
+
+template <int N, int DtMs>
+void IpoptBackend<N, DtMs>::Solve(const Eigen::VectorXd& coeffs,
+                                  const MPCWeights& weights, bool warm,
+                                  std::vector<double>& vars,
+                                  MPCSolveStats& stats) {
+  fg_nlp->SetParams(coeffs.data(), weights);
+  fg_nlp->Prepare();
+  fg_nlp->vars = vars;
+
+  // Set init state lower and upper limits
+  Dvector& constraints_lowerbound = fg_nlp->constraints_lowerbound;
+  Dvector& constraints_upperbound = fg_nlp->constraints_upperbound;
+  const int starts[] = {Layout::x_start, Layout::y_start, Layout::psi_start,
+                        Layout::v_start, Layout::cte_start, Layout::epsi_start};
+  for (int s = 0; s < 6; s++) {
+    constraints_lowerbound[starts[s]] = vars[starts[s]];
+    constraints_upperbound[starts[s]] = vars[starts[s]];
+  }
+
+  // Multipliers of the previous solution, shifted like the variables. The
+  // multipliers of the initial state constraints stay where they are.
+  warm = warm && !prev_lambda.empty();
+  if (warm) {
+    Dvector& z_lower = fg_nlp->z_lower;
+    Dvector& z_upper = fg_nlp->z_upper;
+    Dvector& lambda = fg_nlp->lambda;
+    for (int s = 0; s < 6; s++) {
+      shiftSteps(prev_z_lower, z_lower, starts[s], N);
+      shiftSteps(prev_z_upper, z_upper, starts[s], N);
+      lambda[starts[s]] = prev_lambda[starts[s]];
+      shiftSteps(prev_lambda, lambda, starts[s] + 1, N - 1);
+    }
+    shiftSteps(prev_z_lower, z_lower, Layout::delta_start, N - 1);
+    shiftSteps(prev_z_upper, z_upper, Layout::delta_start, N - 1);
+    shiftSteps(prev_z_lower, z_lower, Layout::a_start, N - 1);
+    shiftSteps(prev_z_upper, z_upper, Layout::a_start, N - 1);
+  }
+
+  // A warm start begins at the shifted multipliers and keeps the interior
+  // point close to the bounds it starts at, instead of pushing it back to the
+  // center
+  app->Options()->SetStringValue("warm_start_init_point", warm ? "yes" : "no");
+  app->Options()->SetNumericValue("mu_init", warm ? 1e-4 : 0.1);
+
+  // solve the problem
+  if (status == Ipopt::Solve_Succeeded || optimized) {
+    status = optimized ? app->ReOptimizeTNLP(nlp) : app->OptimizeTNLP(nlp);
+    optimized = true;
+  }
+
+  // Check some of the solution values
+  bool ok = fg_nlp->Status() == Ipopt::SUCCESS ||
+            fg_nlp->Status() == Ipopt::STOP_AT_ACCEPTABLE_POINT;
+
+  stats.success = ok;
+  stats.iterations = fg_nlp->Iterations();
+  stats.cost = fg_nlp->ObjValue();
+  vars = fg_nlp->vars;
+
+  if (ok) {
+    prev_z_lower = fg_nlp->z_lower;
+    prev_z_upper = fg_nlp->z_upper;
+    prev_lambda = fg_nlp->lambda;
+  } else {
+    prev_z_lower.clear();
+    prev_z_upper.clear();
+    prev_lambda.clear();
+  }
+}
+
+// Definitions for each horizon of MPC_HORIZONS
+#define INSTANTIATE_IPOPT(N, DtMs) template class IpoptBackend<N, DtMs>;
+MPC_HORIZONS(INSTANTIATE_IPOPT)
@@ -0,0 +1,41 @@
+#ifndef MPC_IPOPT_H
+#define MPC_IPOPT_H
+
+#include <vector>
+#include <coin/IpIpoptApplication.hpp>
+#include "mpc_backend.h"
+#include "mpc_nlp.h"
+
+//
+// Ipopt on the full nonlinear problem, the reference backend. The problem
+// (FG_nlp) and the Ipopt instance are created once and reused by every solve.
+// Warm starts also reuse the bound and constraint multipliers of the
+// previous solve, shifted like the variables.
+//
+template <int N, int DtMs = 100>
+class IpoptBackend : public MPCBackend {
+ public:
+  typedef MPCLayout<N, DtMs> Layout;
+
+  // @param analytic_derivatives Use FG_analytic instead of a CppAD tape
+  explicit IpoptBackend(bool analytic_derivatives);
+
+  void Solve(const Eigen::VectorXd& coeffs, const MPCWeights& weights,
+             bool warm, std::vector<double>& vars, MPCSolveStats& stats);
+
+ private:
+  FG_nlp<N, DtMs>* fg_nlp;
+  Ipopt::SmartPtr<Ipopt::TNLP> nlp;
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+  // Ipopt status of Initialize, then of the last optimization
+  Ipopt::ApplicationReturnStatus status;
+  // The first optimization sets up Ipopt for the problem, later ones reuse it
+  bool optimized;
+
+  // Multipliers of the last solve, empty unless it succeeded
+  std::vector<double> prev_z_lower;
+  std::vector<double> prev_z_upper;
+  std::vector<double> prev_lambda;
+};
+
+#endif /* MPC_IPOPT_H */
@@ -0,0 +1,202 @@
+// Times the work of a control cycle outside the solver, on the telemetry of a
+// lap of the offline closed loop of simulator.h, so it needs neither Ipopt
+// nor a recording from the simulator: the fit of the reference polynomial per
+// message against the QR fit it replaced, and one Ipopt iteration's worth of
+// derivative evaluations from FG_analytic. mpc_benchmark compares the latter
+// with the CppAD tape.
+//
+// Usage: mpc_microbench [TRACK]
+//
+// TRACK defaults to ../lake_track_waypoints.csv. The lap is driven by the QP
+// backend with the waypoints the simulator would send.
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/QR"
+#include "MPC.h"
+#include "mpc_model.h"
+#include "simulator.h"
+#include "telemetry.h"
+
+// The fit telemetry.cpp used before polyfit<3>: a Householder QR of the
+// Vandermonde matrix, on heap-allocated copies of the points
+static Eigen::VectorXd polyfitQR(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
+                                 int order) {
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+  for (int j = 0; j < xvals.size(); j++) {
+    A(j, 0) = 1.0;
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+  return A.householderQr().solve(yvals);
+}
+
+// Times the cubic fit and the cte it gives per telemetry message, with the
+// QR fit and pow() terms it replaced and with polyfit<3> and Horner's rule,
+// and the whole of prepareControlInput. Checks that both fits agree at the
+// waypoints.
+static void benchmarkPolyfit(const vector<Telemetry> &events) {
+  const int passes = std::max(1, int(100000 / events.size()));
+  vector<ControlInput> inputs(events.size());
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], 0, 0.1, inputs[k]);
+  }
+
+  // Keeps the compiler from dropping the timed work
+  volatile double sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t k = 0; k < inputs.size(); k++) {
+      const ControlInput &input = inputs[k];
+      Eigen::VectorXd coeffs = polyfitQR(
+          Eigen::VectorXd::Map(input.ptsx.data(), input.ptsx.size()),
+          Eigen::VectorXd::Map(input.ptsy.data(), input.ptsy.size()), 3);
+      for (int i = 0; i < coeffs.size(); i++) {
+        sink += coeffs[i] * pow(0.0, i);
+      }
+    }
+  }
+  auto qr_end = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t k = 0; k < inputs.size(); k++) {
+      Eigen::Vector4d coeffs;
+      polyfit<3>(inputs[k].ptsx, inputs[k].ptsy, coeffs);
+      sink += polyeval(coeffs, 0.0);
+    }
+  }
+  auto fit_end = std::chrono::steady_clock::now();
+  ControlInput input;
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t k = 0; k < events.size(); k++) {
+      prepareControlInput(events[k], 0, 0.1, input);
+      sink += input.state[4];
+    }
+  }
+  auto prepare_end = std::chrono::steady_clock::now();
+
+  double max_difference = 0;
+  for (size_t k = 0; k < inputs.size(); k++) {
+    const ControlInput &input = inputs[k];
+    Eigen::VectorXd reference = polyfitQR(
+        Eigen::VectorXd::Map(input.ptsx.data(), input.ptsx.size()),
+        Eigen::VectorXd::Map(input.ptsy.data(), input.ptsy.size()), 3);
+    for (size_t i = 0; i < input.ptsx.size(); i++) {
+      max_difference = std::max(
+          max_difference, fabs(polyeval(input.coeffs, input.ptsx[i]) -
+                               polyeval(reference, input.ptsx[i])));
+    }
+  }
+
+  double count = double(passes) * events.size();
+  auto ns = [count](std::chrono::steady_clock::time_point from,
+                    std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::nano>(to - from).count() / count;
+  };
+  printf("\nReference polynomial per message, %zu messages x %d passes\n",
+         events.size(), passes);
+  printf("%-14s %9s\n", "step", "ns");
+  printf("%-14s %9.0f\n", "fit-qr", ns(start, qr_end));
+  printf("%-14s %9.0f\n", "fit-normal", ns(qr_end, fit_end));
+  printf("%-14s %9.0f\n", "prepare-input", ns(fit_end, prepare_end));
+  printf("max difference of the fits at the waypoints: %.3g m\n",
+         max_difference);
+}
+
+// Times cost, constraints, gradient, Jacobian and Lagrangian Hessian from
+// FG_analytic, as mpc_benchmark's benchmarkDerivatives evaluates them, at the
+// trajectory each message's initial state leads to under a mild turn and
+// throttle
+template <int N>
+static void benchmarkAnalytic(const vector<Telemetry> &events) {
+  typedef MPCLayout<N> Layout;
+  FG_analytic<N> fg;
+  fg.SetWeights(MPCWeights());
+
+  vector<vector<double> > params;
+  vector<vector<double> > points;
+  ControlInput input;
+  for (size_t k = 0; k < events.size(); k++) {
+    prepareControlInput(events[k], 0, 0.1, input);
+    vector<double> vars(Layout::n_vars, 0.0);
+    vars[Layout::x_start] = input.state[0];
+    vars[Layout::y_start] = input.state[1];
+    vars[Layout::psi_start] = input.state[2];
+    vars[Layout::v_start] = input.state[3];
+    vars[Layout::cte_start] = input.state[4];
+    vars[Layout::epsi_start] = input.state[5];
+    for (int i = 0; i < N - 1; i++) {
+      vars[Layout::delta_start + i] = 0.05;
+      vars[Layout::a_start + i] = 0.5;
+    }
+    rollout<N, 100>(input.coeffs, vars);
+    points.push_back(vars);
+    params.push_back(
+        vector<double>(input.coeffs.data(), input.coeffs.data() + 4));
+  }
+  vector<double> lambda(Layout::n_constraints);
+  for (int i = 0; i < Layout::n_constraints; i++) {
+    lambda[i] = 1.0 / (1 + i % N);
+  }
+
+  vector<double> g(Layout::n_constraints);
+  vector<double> grad(Layout::n_vars);
+  vector<double> jac(fg.JacobianSize());
+  vector<double> hes(fg.HessianSize());
+  const int passes = std::max(1, int(20000 / points.size()));
+  volatile double sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t k = 0; k < points.size(); k++) {
+      const double *x = points[k].data();
+      fg.SetCoeffs(params[k].data());
+      sink += fg.Cost(x);
+      fg.Constraints(x, g.data());
+      fg.CostGradient(x, grad.data());
+      fg.Jacobian(x, jac.data());
+      fg.Hessian(x, 1, lambda.data(), hes.data());
+      sink += g[0] + grad[0] + jac[0] + hes[0];
+    }
+  }
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start).count() /
+              (double(passes) * points.size());
+  printf("%3d %9.2f %9d %9d\n", N, us, fg.JacobianSize(), fg.HessianSize());
+}
+
+int main(int argc, char *argv[]) {
+  std::string file = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  Track track;
+  if (!track.Load(file)) {
+    std::cerr << "Failed to load track " << file << std::endl;
+    return -1;
+  }
+
+  SimConfig cfg;
+  cfg.record_telemetry = true;
+  SimResult result;
+  MPC<10> mpc;
+  mpc.solver_type = MPC_SOLVER_QP;
+  simulate(track, cfg, mpc, result);
+  if (result.telemetry.empty()) {
+    std::cerr << "No telemetry from " << file << std::endl;
+    return -1;
+  }
+  printf("track %s, %zu messages from a %s lap\n", file.c_str(),
+         result.telemetry.size(), result.completed ? "full" : "partial");
+
+  benchmarkPolyfit(result.telemetry);
+
+  printf("\nFG_analytic derivatives per Ipopt iteration (f, g, grad f, "
+         "Jacobian, Hessian), %zu points\n", result.telemetry.size());
+  printf("%3s %9s %9s %9s\n", "N", "us", "jac_nnz", "hes_nnz");
+  benchmarkAnalytic<5>(result.telemetry);
+  benchmarkAnalytic<10>(result.telemetry);
+  benchmarkAnalytic<20>(result.telemetry);
+  return 0;
+}
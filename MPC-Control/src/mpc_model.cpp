@@ -0,0 +1,351 @@
+#include "mpc_model.h"
+#include <math.h>
+
+// This value assumes the model presented in the classroom is used.
+//
+// It was obtained by measuring the radius formed by running the vehicle in the
+// simulator around in a circle with a constant steering angle and velocity on a
+// flat terrain.
+//
+// Lf was tuned until the the radius formed by the simulating the model
+// presented in the classroom matched the previous radius.
+//
+// This is the length from front to CoG that has a similar radius.
+extern const double Lf = 2.67;
+
+// max values allowed in simulator
+extern const double max_delta = M_PI/8;
+extern const double max_a = 1.0;
+
+template <int N, int DtMs>
+void rollout(const Eigen::VectorXd& coeffs, std::vector<double>& vars) {
+  typedef MPCLayout<N, DtMs> Layout;
+  constexpr double dt = Layout::dt;
+  for (int i = 0; i < N - 1; i++) {
+    double x0 = vars[Layout::x_start + i];
+    double y0 = vars[Layout::y_start + i];
+    double psi0 = vars[Layout::psi_start + i];
+    double v0 = vars[Layout::v_start + i];
+    double epsi0 = vars[Layout::epsi_start + i];
+    double delta0 = vars[Layout::delta_start + i];
+    double a0 = vars[Layout::a_start + i];
+
+    double f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0,2) + coeffs[3] * pow(x0,3);
+    double psides0 = atan(coeffs[1] + (2 * coeffs[2] * x0) + (3 * coeffs[3]* pow(x0,2) ));
+
+    vars[Layout::x_start + i + 1] = x0 + v0 * cos(psi0) * dt;
+    vars[Layout::y_start + i + 1] = y0 + v0 * sin(psi0) * dt;
+    vars[Layout::psi_start + i + 1] = psi0 - v0 * delta0 / Lf * dt;
+    vars[Layout::v_start + i + 1] = v0 + a0 * dt;
+    vars[Layout::cte_start + i + 1] = (f0 - y0) + (v0 * sin(epsi0) * dt);
+    vars[Layout::epsi_start + i + 1] = (psi0 - psides0) - v0 * delta0 / Lf * dt;
+  }
+}
+
+void shiftSteps(const std::vector<double>& prev, std::vector<double>& next,
+                int start, int length) {
+  for (int i = 0; i < length - 1; i++) {
+    next[start + i] = prev[start + i + 1];
+  }
+  next[start + length - 1] = prev[start + length - 1];
+}
+
+namespace {
+
+// Receivers of the triplets FG_analytic generates
+struct CountSink {
+  int k;
+  void put(int, int, double) { k++; }
+};
+
+struct StructureSink {
+  int* row;
+  int* col;
+  int k;
+  void put(int r, int c, double) {
+    row[k] = r;
+    col[k] = c;
+    k++;
+  }
+};
+
+struct ValueSink {
+  double* values;
+  int k;
+  void put(int, int, double value) { values[k++] = value; }
+};
+
+}  // namespace
+
+template <int N, int DtMs>
+FG_analytic<N, DtMs>::FG_analytic()
+    : coeffs(), zeros(Layout::n_vars, 0.0) {
+  CountSink count = {0};
+  jacobian(zeros.data(), count);
+  jac_size = count.k;
+  count.k = 0;
+  hessian(zeros.data(), 0, zeros.data(), count);
+  hes_size = count.k;
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::SetCoeffs(const double* coeffs) {
+  for (int i = 0; i < 4; i++) {
+    this->coeffs[i] = coeffs[i];
+  }
+}
+
+template <int N, int DtMs>
+double FG_analytic<N, DtMs>::Cost(const double* vars) const {
+  const MPCWeights& w = weights;
+  double cost = 0;
+  for (int i = 0; i < N; i++) {
+    double cte = vars[Layout::cte_start + i] - w.ref_cte;
+    double epsi = vars[Layout::epsi_start + i] - w.ref_epsi;
+    double v = vars[Layout::v_start + i] - w.ref_v;
+    cost += w.cte * cte * cte + w.epsi * epsi * epsi + w.v * v * v;
+  }
+  for (int i = 0; i < N - 1; i++) {
+    double delta = vars[Layout::delta_start + i];
+    double a = vars[Layout::a_start + i];
+    cost += w.delta * delta * delta + w.a * a * a;
+  }
+  for (int i = 0; i < N - 2; i++) {
+    double ddelta = vars[Layout::delta_start + i + 1] - vars[Layout::delta_start + i];
+    double da = vars[Layout::a_start + i + 1] - vars[Layout::a_start + i];
+    cost += w.delta_rate * ddelta * ddelta + w.a_rate * da * da;
+  }
+  return cost;
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::CostGradient(const double* vars, double* grad) const {
+  const MPCWeights& w = weights;
+  for (int j = 0; j < Layout::n_vars; j++) {
+    grad[j] = 0;
+  }
+  for (int i = 0; i < N; i++) {
+    grad[Layout::cte_start + i] =
+        2 * w.cte * (vars[Layout::cte_start + i] - w.ref_cte);
+    grad[Layout::epsi_start + i] =
+        2 * w.epsi * (vars[Layout::epsi_start + i] - w.ref_epsi);
+    grad[Layout::v_start + i] = 2 * w.v * (vars[Layout::v_start + i] - w.ref_v);
+  }
+  for (int i = 0; i < N - 1; i++) {
+    grad[Layout::delta_start + i] = 2 * w.delta * vars[Layout::delta_start + i];
+    grad[Layout::a_start + i] = 2 * w.a * vars[Layout::a_start + i];
+  }
+  for (int i = 0; i < N - 2; i++) {
+    double ddelta = vars[Layout::delta_start + i + 1] - vars[Layout::delta_start + i];
+    double da = vars[Layout::a_start + i + 1] - vars[Layout::a_start + i];
+    grad[Layout::delta_start + i + 1] += 2 * w.delta_rate * ddelta;
+    grad[Layout::delta_start + i] -= 2 * w.delta_rate * ddelta;
+    grad[Layout::a_start + i + 1] += 2 * w.a_rate * da;
+    grad[Layout::a_start + i] -= 2 * w.a_rate * da;
+  }
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::Constraints(const double* vars, double* g) const {
+  constexpr double dt = Layout::dt;
+  g[Layout::x_start] = vars[Layout::x_start];
+  g[Layout::y_start] = vars[Layout::y_start];
+  g[Layout::psi_start] = vars[Layout::psi_start];
+  g[Layout::v_start] = vars[Layout::v_start];
+  g[Layout::cte_start] = vars[Layout::cte_start];
+  g[Layout::epsi_start] = vars[Layout::epsi_start];
+
+  for (int i = 0; i < N - 1; i++) {
+    double x0 = vars[Layout::x_start + i];
+    double y0 = vars[Layout::y_start + i];
+    double psi0 = vars[Layout::psi_start + i];
+    double v0 = vars[Layout::v_start + i];
+    double epsi0 = vars[Layout::epsi_start + i];
+    double delta0 = vars[Layout::delta_start + i];
+    double a0 = vars[Layout::a_start + i];
+
+    // Horner form of the cubic and of its derivative
+    double f0 = coeffs[0] + x0 * (coeffs[1] + x0 * (coeffs[2] + x0 * coeffs[3]));
+    double psides0 = atan(coeffs[1] + x0 * (2 * coeffs[2] + x0 * 3 * coeffs[3]));
+
+    g[Layout::x_start + i + 1] =
+        vars[Layout::x_start + i + 1] - (x0 + v0 * cos(psi0) * dt);
+    g[Layout::y_start + i + 1] =
+        vars[Layout::y_start + i + 1] - (y0 + v0 * sin(psi0) * dt);
+    g[Layout::psi_start + i + 1] =
+        vars[Layout::psi_start + i + 1] - (psi0 - v0 * delta0 / Lf * dt);
+    g[Layout::v_start + i + 1] = vars[Layout::v_start + i + 1] - (v0 + a0 * dt);
+    g[Layout::cte_start + i + 1] =
+        vars[Layout::cte_start + i + 1] - ((f0 - y0) + (v0 * sin(epsi0) * dt));
+    g[Layout::epsi_start + i + 1] =
+        vars[Layout::epsi_start + i + 1] - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+  }
+}
+
+template <int N, int DtMs>
+template <class Sink>
+void FG_analytic<N, DtMs>::jacobian(const double* vars, Sink& sink) const {
+  constexpr double dt = Layout::dt;
+  // Initial state rows
+  sink.put(Layout::x_start, Layout::x_start, 1);
+  sink.put(Layout::y_start, Layout::y_start, 1);
+  sink.put(Layout::psi_start, Layout::psi_start, 1);
+  sink.put(Layout::v_start, Layout::v_start, 1);
+  sink.put(Layout::cte_start, Layout::cte_start, 1);
+  sink.put(Layout::epsi_start, Layout::epsi_start, 1);
+
+  // Rows of the step from i to i + 1
+  for (int i = 0; i < N - 1; i++) {
+    double x0 = vars[Layout::x_start + i];
+    double psi0 = vars[Layout::psi_start + i];
+    double v0 = vars[Layout::v_start + i];
+    double epsi0 = vars[Layout::epsi_start + i];
+    double delta0 = vars[Layout::delta_start + i];
+
+    // Slope and curvature term of the reference line at x0
+    double df0 = coeffs[1] + x0 * (2 * coeffs[2] + x0 * 3 * coeffs[3]);
+    double ddf0 = 2 * coeffs[2] + x0 * 6 * coeffs[3];
+    double cos_psi0 = cos(psi0);
+    double sin_psi0 = sin(psi0);
+
+    int r = Layout::x_start + i + 1;
+    sink.put(r, Layout::x_start + i + 1, 1);
+    sink.put(r, Layout::x_start + i, -1);
+    sink.put(r, Layout::psi_start + i, v0 * sin_psi0 * dt);
+    sink.put(r, Layout::v_start + i, -cos_psi0 * dt);
+
+    r = Layout::y_start + i + 1;
+    sink.put(r, Layout::y_start + i + 1, 1);
+    sink.put(r, Layout::y_start + i, -1);
+    sink.put(r, Layout::psi_start + i, -v0 * cos_psi0 * dt);
+    sink.put(r, Layout::v_start + i, -sin_psi0 * dt);
+
+    r = Layout::psi_start + i + 1;
+    sink.put(r, Layout::psi_start + i + 1, 1);
+    sink.put(r, Layout::psi_start + i, -1);
+    sink.put(r, Layout::v_start + i, delta0 / Lf * dt);
+    sink.put(r, Layout::delta_start + i, v0 / Lf * dt);
+
+    r = Layout::v_start + i + 1;
+    sink.put(r, Layout::v_start + i + 1, 1);
+    sink.put(r, Layout::v_start + i, -1);
+    sink.put(r, Layout::a_start + i, -dt);
+
+    r = Layout::cte_start + i + 1;
+    sink.put(r, Layout::cte_start + i + 1, 1);
+    sink.put(r, Layout::x_start + i, -df0);
+    sink.put(r, Layout::y_start + i, 1);
+    sink.put(r, Layout::v_start + i, -sin(epsi0) * dt);
+    sink.put(r, Layout::epsi_start + i, -v0 * cos(epsi0) * dt);
+
+    r = Layout::epsi_start + i + 1;
+    sink.put(r, Layout::epsi_start + i + 1, 1);
+    sink.put(r, Layout::x_start + i, ddf0 / (1 + df0 * df0));
+    sink.put(r, Layout::psi_start + i, -1);
+    sink.put(r, Layout::v_start + i, delta0 / Lf * dt);
+    sink.put(r, Layout::delta_start + i, v0 / Lf * dt);
+  }
+}
+
+template <int N, int DtMs>
+template <class Sink>
+void FG_analytic<N, DtMs>::hessian(const double* vars, double obj_factor,
+                                   const double* lambda, Sink& sink) const {
+  constexpr double dt = Layout::dt;
+  // Curvatures of the squared cost terms
+  double h_cte = 2 * weights.cte * obj_factor;
+  double h_epsi = 2 * weights.epsi * obj_factor;
+  double h_v = 2 * weights.v * obj_factor;
+  double h_delta = 2 * weights.delta * obj_factor;
+  double h_a = 2 * weights.a * obj_factor;
+  double h_delta_rate = 2 * weights.delta_rate * obj_factor;
+  double h_a_rate = 2 * weights.a_rate * obj_factor;
+  for (int i = 0; i < N; i++) {
+    // Only the cost acts on the last step
+    bool step = i < N - 1;
+
+    if (step) {
+      double x0 = vars[Layout::x_start + i];
+      double psi0 = vars[Layout::psi_start + i];
+      double v0 = vars[Layout::v_start + i];
+      double epsi0 = vars[Layout::epsi_start + i];
+
+      double lx = lambda[Layout::x_start + i + 1];
+      double ly = lambda[Layout::y_start + i + 1];
+      double lpsi = lambda[Layout::psi_start + i + 1];
+      double lcte = lambda[Layout::cte_start + i + 1];
+      double lepsi = lambda[Layout::epsi_start + i + 1];
+
+      // psides = atan(f'), so psides'' = f''' / (1 + f'^2) - 2 f' f''^2 / (1 + f'^2)^2
+      double df0 = coeffs[1] + x0 * (2 * coeffs[2] + x0 * 3 * coeffs[3]);
+      double ddf0 = 2 * coeffs[2] + x0 * 6 * coeffs[3];
+      double dddf0 = 6 * coeffs[3];
+      double q = 1 + df0 * df0;
+      double ddpsides0 = dddf0 / q - 2 * df0 * ddf0 * ddf0 / (q * q);
+      double cos_psi0 = cos(psi0);
+      double sin_psi0 = sin(psi0);
+
+      sink.put(Layout::x_start + i, Layout::x_start + i,
+               -lcte * ddf0 + lepsi * ddpsides0);
+      sink.put(Layout::psi_start + i, Layout::psi_start + i,
+               (lx * cos_psi0 + ly * sin_psi0) * v0 * dt);
+      sink.put(Layout::v_start + i, Layout::psi_start + i,
+               (lx * sin_psi0 - ly * cos_psi0) * dt);
+      sink.put(Layout::v_start + i, Layout::v_start + i, h_v);
+      sink.put(Layout::cte_start + i, Layout::cte_start + i, h_cte);
+      sink.put(Layout::epsi_start + i, Layout::v_start + i, -lcte * cos(epsi0) * dt);
+      sink.put(Layout::epsi_start + i, Layout::epsi_start + i,
+               h_epsi + lcte * v0 * sin(epsi0) * dt);
+      sink.put(Layout::delta_start + i, Layout::v_start + i, (lpsi + lepsi) / Lf * dt);
+
+      // Actuator and actuator rate cost
+      int rates = (i > 0 ? 1 : 0) + (i < N - 2 ? 1 : 0);
+      sink.put(Layout::delta_start + i, Layout::delta_start + i,
+               h_delta + h_delta_rate * rates);
+      if (i > 0) {
+        sink.put(Layout::delta_start + i, Layout::delta_start + i - 1,
+                 -h_delta_rate);
+      }
+      sink.put(Layout::a_start + i, Layout::a_start + i, h_a + h_a_rate * rates);
+      if (i > 0) {
+        sink.put(Layout::a_start + i, Layout::a_start + i - 1, -h_a_rate);
+      }
+    } else {
+      sink.put(Layout::v_start + i, Layout::v_start + i, h_v);
+      sink.put(Layout::cte_start + i, Layout::cte_start + i, h_cte);
+      sink.put(Layout::epsi_start + i, Layout::epsi_start + i, h_epsi);
+    }
+  }
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::JacobianStructure(int* row, int* col) const {
+  StructureSink sink = {row, col, 0};
+  jacobian(zeros.data(), sink);
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::Jacobian(const double* vars, double* values) const {
+  ValueSink sink = {values, 0};
+  jacobian(vars, sink);
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::HessianStructure(int* row, int* col) const {
+  StructureSink sink = {row, col, 0};
+  hessian(zeros.data(), 0, zeros.data(), sink);
+}
+
+template <int N, int DtMs>
+void FG_analytic<N, DtMs>::Hessian(const double* vars, double obj_factor,
+                                   const double* lambda, double* values) const {
+  ValueSink sink = {values, 0};
+  hessian(vars, obj_factor, lambda, sink);
+}
+
+// Definitions for each horizon of MPC_HORIZONS
+#define INSTANTIATE_MODEL(N, DtMs)                              \
+  template void rollout<N, DtMs>(const Eigen::VectorXd& coeffs, \
+                                 std::vector<double>& vars);    \
+  template class FG_analytic<N, DtMs>;
+MPC_HORIZONS(INSTANTIATE_MODEL)
@@ -0,0 +1,142 @@
+#ifndef MPC_MODEL_H
+#define MPC_MODEL_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+// Length from front to CoG, see mpc_model.cpp
+extern const double Lf;
+
+// Actuator limits, steering angle [rad] and acceleration
+extern const double max_delta;
+extern const double max_a;
+
+// Weights of the cost terms and the references they pull towards, read by
+// every solve
+struct MPCWeights {
+  double cte = 1;         // (cte - ref_cte)^2 per step
+  double epsi = 1;        // (epsi - ref_epsi)^2 per step
+  double v = 1;           // (v - ref_v)^2 per step
+  double delta = 5;       // delta^2 per actuation
+  double a = 5;           // a^2 per actuation
+  double delta_rate = 1;  // (delta change between actuations)^2
+  double a_rate = 1;      // (a change between actuations)^2
+
+  // Reference cross-track error, orientation error and speed
+  double ref_cte = 0;
+  double ref_epsi = 0;
+  double ref_v = 20;
+};
+
+//
+// Variables of a horizon of N look ahead steps of DtMs milliseconds each: the
+// N values of every state component, then the N - 1 values of every actuator.
+// All of it is a constant expression, so the loops over the horizon have
+// compile-time trip counts, and controllers with different horizons can
+// coexist in one process.
+//
+template <int N, int DtMs = 100>
+struct MPCLayout {
+  static constexpr double dt = DtMs / 1000.0;
+
+  // FG state and actuator indices
+  static constexpr int x_start = 0;
+  static constexpr int y_start = x_start + N;
+  static constexpr int psi_start = y_start + N;
+  static constexpr int v_start = psi_start + N;
+  static constexpr int cte_start = v_start + N;
+  static constexpr int epsi_start = cte_start + N;
+  static constexpr int delta_start = epsi_start + N;
+  static constexpr int a_start = delta_start + N - 1;
+
+  static constexpr int n_vars = 6 * N + 2 * (N - 1);
+  static constexpr int n_constraints = 6 * N;
+  static constexpr int n_inputs = 2 * (N - 1);
+};
+
+template <int N, int DtMs> constexpr double MPCLayout<N, DtMs>::dt;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::x_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::y_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::psi_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::v_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::cte_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::epsi_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::delta_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::a_start;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::n_vars;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::n_constraints;
+template <int N, int DtMs> constexpr int MPCLayout<N, DtMs>::n_inputs;
+
+// Horizons the controller is compiled for, as X(N, DtMs). The templates are
+// defined in the .cpp files, which instantiate them for each of these.
+#define MPC_HORIZONS(X) \
+  X(5, 100)             \
+  X(10, 100)            \
+  X(20, 100)
+
+// Simulates the kinematic model from the state at step 0 of vars under its
+// actuations, overwriting the states at steps 1 .. N-1. This makes a guess
+// that satisfies all constraints.
+template <int N, int DtMs>
+void rollout(const Eigen::VectorXd& coeffs, std::vector<double>& vars);
+
+// Moves the entries start + 1 .. start + length - 1 of prev one step earlier
+// into next, repeating the last one.
+void shiftSteps(const std::vector<double>& prev, std::vector<double>& next,
+                int start, int length);
+
+//
+// Cost and constraints of the MPC problem with hand-derived derivatives.
+// Evaluates exactly what FG_eval tapes (constraint i is fg[1 + i] there), but
+// as straight-line code: the gradient, the constraint Jacobian and the
+// Hessian of the Lagrangian are closed-form expressions per step instead of
+// tape sweeps. The sparsity structure follows from the model and is fixed by
+// the layout.
+//
+template <int N, int DtMs = 100>
+class FG_analytic {
+ public:
+  typedef MPCLayout<N, DtMs> Layout;
+
+  FG_analytic();
+
+  // Polynomial coefficients c0 .. c3 of the reference line
+  void SetCoeffs(const double* coeffs);
+  void SetWeights(const MPCWeights& weights) { this->weights = weights; }
+
+  int NumVars() const { return Layout::n_vars; }
+  int NumConstraints() const { return Layout::n_constraints; }
+
+  double Cost(const double* vars) const;
+  void CostGradient(const double* vars, double* grad) const;
+  void Constraints(const double* vars, double* g) const;
+
+  // Constraint Jacobian in triplet form, JacobianSize() entries
+  int JacobianSize() const { return jac_size; }
+  void JacobianStructure(int* row, int* col) const;
+  void Jacobian(const double* vars, double* values) const;
+
+  // Lower triangle of obj_factor * cost + lambda' * constraints, each
+  // position once, HessianSize() entries
+  int HessianSize() const { return hes_size; }
+  void HessianStructure(int* row, int* col) const;
+  void Hessian(const double* vars, double obj_factor, const double* lambda,
+               double* values) const;
+
+ private:
+  // Both the structure and the values come from these, so they always agree
+  template <class Sink>
+  void jacobian(const double* vars, Sink& sink) const;
+  template <class Sink>
+  void hessian(const double* vars, double obj_factor, const double* lambda,
+               Sink& sink) const;
+
+  int jac_size;
+  int hes_size;
+  double coeffs[4];
+  MPCWeights weights;
+  // Point the structure is generated at
+  std::vector<double> zeros;
+};
+
+#endif /* MPC_MODEL_H */
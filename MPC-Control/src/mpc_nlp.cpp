@@ -0,0 +1,413 @@
+#include "mpc_nlp.h"
+#include <math.h>
+#include <algorithm>
+
+using CppAD::AD;
+
+template <int N, int DtMs>
+class FG_eval {
+ public:
+  typedef MPCLayout<N, DtMs> Layout;
+  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+
+  // Fitted polynomial coefficients, taped as parameters of the problem
+  ADvector coeffs;
+  // Cost weights and references, parameters as well, in the field order of
+  // MPCWeights
+  ADvector weights;
+  FG_eval(const ADvector& coeffs, const ADvector& weights)
+      : coeffs(coeffs), weights(weights) {}
+
+  // Fills fg with the cost followed by the constraints at vars
+  void operator()(ADvector& fg, const ADvector& vars) {
+    //
+    // Reference state cost
+    //
+
+    constexpr double dt = Layout::dt;
+    const AD<double>& w_cte = weights[0];
+    const AD<double>& w_epsi = weights[1];
+    const AD<double>& w_v = weights[2];
+    const AD<double>& w_delta = weights[3];
+    const AD<double>& w_a = weights[4];
+    const AD<double>& w_delta_rate = weights[5];
+    const AD<double>& w_a_rate = weights[6];
+    const AD<double>& ref_cte = weights[7];
+    const AD<double>& ref_epsi = weights[8];
+    const AD<double>& ref_v = weights[9];
+
+    // Initialise cost to zero
+    fg[0] = 0;
+
+    //CTE distance cost
+    for (int i = 0; i < N; i++) {
+      fg[0] += w_cte * pow(vars[Layout::cte_start + i] - ref_cte, 2);
+      fg[0] += w_epsi * pow(vars[Layout::epsi_start + i] - ref_epsi, 2);
+      fg[0] += w_v * pow(vars[Layout::v_start + i] - ref_v, 2);
+    }
+
+    //Actuators cost
+    for (int i = 0; i < N - 1; i++) {
+      fg[0] += w_delta * pow(vars[Layout::delta_start + i], 2);
+      fg[0] += w_a * pow(vars[Layout::a_start + i], 2);
+    }
+
+    // Actuator rate/differential cost
+    for (int i=0; i < N-2; i++) {
+      fg[0] += w_delta_rate *
+               pow(vars[Layout::delta_start + i + 1] - vars[Layout::delta_start + i], 2);
+      fg[0] += w_a_rate *
+               pow(vars[Layout::a_start + i + 1] - vars[Layout::a_start + i], 2);
+    }
+
+    // Add 1 to each of the starting indices since cost is at fg[0]
+    fg[1 + Layout::x_start] = vars[Layout::x_start];
+    fg[1 + Layout::y_start] = vars[Layout::y_start];
+    fg[1 + Layout::psi_start] = vars[Layout::psi_start];
+    fg[1 + Layout::v_start] = vars[Layout::v_start];
+    fg[1 + Layout::cte_start] = vars[Layout::cte_start];
+    fg[1 + Layout::epsi_start] = vars[Layout::epsi_start];
+
+    // Set predicted states at other timesteps (from eqns)
+    // N - 1 because we're only predicting (N-1) times
+    for (int i = 0; i < N - 1; i++) {
+      // The state at time t+1 .
+      AD<double> x1 = vars[Layout::x_start + i + 1];
+      AD<double> y1 = vars[Layout::y_start + i + 1];
+      AD<double> psi1 = vars[Layout::psi_start + i + 1];
+      AD<double> v1 = vars[Layout::v_start + i + 1];
+      AD<double> cte1 = vars[Layout::cte_start + i + 1];
+      AD<double> epsi1 = vars[Layout::epsi_start + i + 1];
+
+      // The state at time t.
+      AD<double> x0 = vars[Layout::x_start + i];
+      AD<double> y0 = vars[Layout::y_start + i];
+      AD<double> psi0 = vars[Layout::psi_start + i];
+      AD<double> v0 = vars[Layout::v_start + i];
+      AD<double> cte0 = vars[Layout::cte_start + i];
+      AD<double> epsi0 = vars[Layout::epsi_start + i];
+
+      // Only consider the actuation at time t.
+      AD<double> delta0 = vars[Layout::delta_start + i];
+      AD<double> a0 = vars[Layout::a_start + i];
+
+      AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0,2) + coeffs[3] * pow(x0,3);
+      AD<double> psides0 = CppAD::atan(coeffs[1] + (2 * coeffs[2] * x0) + (3 * coeffs[3]* pow(x0,2) ));
+
+      // Fill in fg with differences between actual and predicted states
+      // add 2 to indices because (+1) from cost and (+1) because logging error of prediction (next timestep)
+      fg[2 + Layout::x_start + i] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
+      fg[2 + Layout::y_start + i] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
+      fg[2 + Layout::psi_start + i] = psi1 - (psi0 - v0 * delta0 / Lf * dt);
+      fg[2 + Layout::v_start + i] = v1 - (v0 + a0 * dt);
+      fg[2 + Layout::cte_start + i] =
+      cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
+      fg[2 + Layout::epsi_start + i] =
+      epsi1 - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+    }
+  }
+};
+
+template <int N, int DtMs>
+FG_nlp<N, DtMs>::FG_nlp(bool analytic)
+    : vars(n), z_lower(n), z_upper(n), lambda(m), vars_lowerbound(n),
+      vars_upperbound(n), constraints_lowerbound(m), constraints_upperbound(m),
+      params(n_params), analytic(analytic), status(Ipopt::INTERNAL_ERROR),
+      obj_value(0), iterations(0) {
+  if (analytic) {
+    return;
+  }
+
+  // Record fg as a function of [vars, params]. FG_eval has no branches on
+  // its inputs, so the tape holds for any of their values.
+  typedef typename FG_eval<N, DtMs>::ADvector ADvector;
+  size_t domain = n + n_params;
+  ADvector ax(domain);
+  for (size_t j = 0; j < domain; j++) {
+    ax[j] = 0.0;
+  }
+  CppAD::Independent(ax);
+  ADvector avars(n);
+  for (size_t j = 0; j < n; j++) {
+    avars[j] = ax[j];
+  }
+  ADvector acoeffs(n_coeffs);
+  for (size_t j = 0; j < n_coeffs; j++) {
+    acoeffs[j] = ax[n + j];
+  }
+  ADvector aweights(n_params - n_coeffs);
+  for (size_t j = n_coeffs; j < n_params; j++) {
+    aweights[j - n_coeffs] = ax[n + j];
+  }
+  ADvector afg(1 + m);
+  FG_eval<N, DtMs> fg_eval(acoeffs, aweights);
+  fg_eval(afg, avars);
+  fun.Dependent(ax, afg);
+  fun.optimize();
+
+  // Jacobian sparsity of fg, then Hessian sparsity of any weighted sum of fg
+  std::vector<std::set<size_t> > identity(domain);
+  for (size_t j = 0; j < domain; j++) {
+    identity[j].insert(j);
+  }
+  jac_pattern = fun.ForSparseJac(domain, identity);
+  std::vector<std::set<size_t> > all_rows(1);
+  for (size_t i = 0; i < 1 + m; i++) {
+    all_rows[0].insert(i);
+  }
+  hes_pattern = fun.RevSparseHes(domain, all_rows);
+
+  // Constraint rows of the Jacobian (row 0 is the cost) and the lower
+  // triangle of the Hessian, restricted to the variables
+  for (size_t i = 1; i < 1 + m; i++) {
+    for (std::set<size_t>::const_iterator j = jac_pattern[i].begin();
+         j != jac_pattern[i].end() && *j < n; ++j) {
+      jac_row.push_back(i);
+      jac_col.push_back(*j);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    for (std::set<size_t>::const_iterator j = hes_pattern[i].begin();
+         j != hes_pattern[i].end() && *j <= i; ++j) {
+      hes_row.push_back(i);
+      hes_col.push_back(*j);
+    }
+  }
+  jac_values.resize(jac_row.size());
+  hes_values.resize(hes_row.size());
+  x.resize(domain);
+  weights.resize(1 + m);
+  cost_weight.assign(1 + m, 0.0);
+  cost_weight[0] = 1.0;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::get_nlp_info(Ipopt::Index& n, Ipopt::Index& m,
+                                   Ipopt::Index& nnz_jac_g,
+                                   Ipopt::Index& nnz_h_lag,
+                                   IndexStyleEnum& index_style) {
+  n = this->n;
+  m = this->m;
+  if (analytic) {
+    nnz_jac_g = fg_analytic.JacobianSize();
+    nnz_h_lag = fg_analytic.HessianSize();
+  } else {
+    nnz_jac_g = jac_row.size();
+    nnz_h_lag = hes_row.size();
+  }
+  index_style = C_STYLE;
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l,
+                                      Ipopt::Number* x_u, Ipopt::Index m,
+                                      Ipopt::Number* g_l, Ipopt::Number* g_u) {
+  for (Ipopt::Index j = 0; j < n; j++) {
+    x_l[j] = vars_lowerbound[j];
+    x_u[j] = vars_upperbound[j];
+  }
+  for (Ipopt::Index i = 0; i < m; i++) {
+    g_l[i] = constraints_lowerbound[i];
+    g_u[i] = constraints_upperbound[i];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::get_starting_point(Ipopt::Index n, bool init_x,
+                                         Ipopt::Number* x, bool init_z,
+                                         Ipopt::Number* z_L, Ipopt::Number* z_U,
+                                         Ipopt::Index m, bool init_lambda,
+                                         Ipopt::Number* lambda) {
+  // Multipliers are only asked for with warm_start_init_point
+  for (Ipopt::Index j = 0; j < n; j++) {
+    if (init_x) {
+      x[j] = vars[j];
+    }
+    if (init_z) {
+      z_L[j] = z_lower[j];
+      z_U[j] = z_upper[j];
+    }
+  }
+  for (Ipopt::Index i = 0; init_lambda && i < m; i++) {
+    lambda[i] = this->lambda[i];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                             Ipopt::Number& obj_value) {
+  if (analytic) {
+    obj_value = fg_analytic.Cost(x);
+    return true;
+  }
+  evaluate(x, new_x);
+  obj_value = fg[0];
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::eval_grad_f(Ipopt::Index n, const Ipopt::Number* x,
+                                  bool new_x, Ipopt::Number* grad_f) {
+  if (analytic) {
+    fg_analytic.CostGradient(x, grad_f);
+    return true;
+  }
+  // Reverse mode sweep of the cost row at x
+  evaluate(x, true);
+  Dvector grad = fun.Reverse(1, cost_weight);
+  for (Ipopt::Index j = 0; j < n; j++) {
+    grad_f[j] = grad[j];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                             Ipopt::Index m, Ipopt::Number* g) {
+  if (analytic) {
+    fg_analytic.Constraints(x, g);
+    return true;
+  }
+  evaluate(x, new_x);
+  for (Ipopt::Index i = 0; i < m; i++) {
+    g[i] = fg[1 + i];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::eval_jac_g(Ipopt::Index n, const Ipopt::Number* x,
+                                 bool new_x, Ipopt::Index m,
+                                 Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                                 Ipopt::Index* jCol, Ipopt::Number* values) {
+  if (analytic) {
+    if (values == NULL) {
+      fg_analytic.JacobianStructure(iRow, jCol);
+    } else {
+      fg_analytic.Jacobian(x, values);
+    }
+    return true;
+  }
+  if (values == NULL) {
+    for (Ipopt::Index k = 0; k < nele_jac; k++) {
+      iRow[k] = jac_row[k] - 1;
+      jCol[k] = jac_col[k];
+    }
+    return true;
+  }
+  // The cached fg belongs to the previous x when Ipopt asks for derivatives
+  // first at a new point
+  if (new_x) {
+    fg.clear();
+  }
+  setPoint(x);
+  fun.SparseJacobianReverse(this->x, jac_pattern, jac_row, jac_col,
+                            jac_values, jac_work);
+  for (Ipopt::Index k = 0; k < nele_jac; k++) {
+    values[k] = jac_values[k];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+bool FG_nlp<N, DtMs>::eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                             Ipopt::Number obj_factor, Ipopt::Index m,
+                             const Ipopt::Number* lambda, bool new_lambda,
+                             Ipopt::Index nele_hess, Ipopt::Index* iRow,
+                             Ipopt::Index* jCol, Ipopt::Number* values) {
+  if (analytic) {
+    if (values == NULL) {
+      fg_analytic.HessianStructure(iRow, jCol);
+    } else {
+      fg_analytic.Hessian(x, obj_factor, lambda, values);
+    }
+    return true;
+  }
+  if (values == NULL) {
+    for (Ipopt::Index k = 0; k < nele_hess; k++) {
+      iRow[k] = hes_row[k];
+      jCol[k] = hes_col[k];
+    }
+    return true;
+  }
+  // Same as in eval_jac_g
+  if (new_x) {
+    fg.clear();
+  }
+  setPoint(x);
+  weights[0] = obj_factor;
+  for (Ipopt::Index i = 0; i < m; i++) {
+    weights[1 + i] = lambda[i];
+  }
+  fun.SparseHessian(this->x, weights, hes_pattern, hes_row, hes_col,
+                    hes_values, hes_work);
+  for (Ipopt::Index k = 0; k < nele_hess; k++) {
+    values[k] = hes_values[k];
+  }
+  return true;
+}
+
+template <int N, int DtMs>
+void FG_nlp<N, DtMs>::finalize_solution(Ipopt::SolverReturn status,
+                                        Ipopt::Index n, const Ipopt::Number* x,
+                                        const Ipopt::Number* z_L,
+                                        const Ipopt::Number* z_U,
+                                        Ipopt::Index m, const Ipopt::Number* g,
+                                        const Ipopt::Number* lambda,
+                                        Ipopt::Number obj_value,
+                                        const Ipopt::IpoptData* ip_data,
+                                        Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  this->status = status;
+  this->obj_value = obj_value;
+  iterations = ip_data != NULL ? ip_data->iter_count() : 0;
+  vars.assign(x, x + n);
+  z_lower.assign(z_L, z_L + n);
+  z_upper.assign(z_U, z_U + n);
+  this->lambda.assign(lambda, lambda + m);
+}
+
+template <int N, int DtMs>
+void FG_nlp<N, DtMs>::SetParams(const double* coeffs,
+                                const MPCWeights& weights) {
+  std::copy(coeffs, coeffs + n_coeffs, params.begin());
+  const double values[] = {weights.cte,      weights.epsi,     weights.v,
+                           weights.delta,    weights.a,        weights.delta_rate,
+                           weights.a_rate,   weights.ref_cte,  weights.ref_epsi,
+                           weights.ref_v};
+  std::copy(values, values + n_params - n_coeffs, params.begin() + n_coeffs);
+  cost_weights = weights;
+}
+
+template <int N, int DtMs>
+void FG_nlp<N, DtMs>::Prepare() {
+  if (analytic) {
+    fg_analytic.SetCoeffs(params.data());
+    fg_analytic.SetWeights(cost_weights);
+  } else {
+    fg.clear();
+  }
+  status = Ipopt::INTERNAL_ERROR;
+  obj_value = 0;
+  iterations = 0;
+}
+
+template <int N, int DtMs>
+void FG_nlp<N, DtMs>::setPoint(const Ipopt::Number* x) {
+  std::copy(x, x + n, this->x.begin());
+  std::copy(params.begin(), params.end(), this->x.begin() + n);
+}
+
+template <int N, int DtMs>
+void FG_nlp<N, DtMs>::evaluate(const Ipopt::Number* x, bool new_x) {
+  if (new_x || fg.empty()) {
+    setPoint(x);
+    fg = fun.Forward(0, this->x);
+  }
+}
+
+// Definitions for each horizon of MPC_HORIZONS
+#define INSTANTIATE_NLP(N, DtMs) template class FG_nlp<N, DtMs>;
+MPC_HORIZONS(INSTANTIATE_NLP)
@@ -0,0 +1,137 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <set>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+#include "mpc_model.h"
+
+//
+// Ipopt problem shared by all solves of an MPC. Its derivatives come either
+// from a CppAD tape of FG_eval or from FG_analytic.
+//
+// The tape is recorded once, with the polynomial coefficients as extra
+// independent variables after the n_vars Ipopt sees, so only their values
+// change between solves. The sparsity patterns of the Jacobian and of the
+// Lagrangian Hessian, and the colorings CppAD computes from them on first use,
+// are kept as well.
+//
+// Each solve sets the parameters, the bounds and the starting point, including bound
+// and constraint multipliers; the solution is written back to the same
+// vectors.
+//
+template <int N, int DtMs = 100>
+class FG_nlp : public Ipopt::TNLP {
+ public:
+  typedef std::vector<double> Dvector;
+
+  // Starting point in, solution out
+  Dvector vars;
+  Dvector z_lower;
+  Dvector z_upper;
+  Dvector lambda;
+
+  Dvector vars_lowerbound;
+  Dvector vars_upperbound;
+  Dvector constraints_lowerbound;
+  Dvector constraints_upperbound;
+
+  // @param analytic Take derivatives from FG_analytic instead of a tape
+  explicit FG_nlp(bool analytic);
+
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                       Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u);
+
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                          bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                          Ipopt::Index m, bool init_lambda,
+                          Ipopt::Number* lambda);
+
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number& obj_value);
+
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                   Ipopt::Number* grad_f);
+
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Index m, Ipopt::Number* g);
+
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol,
+              Ipopt::Number* values);
+
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                         const Ipopt::Number* x, const Ipopt::Number* z_L,
+                         const Ipopt::Number* z_U, Ipopt::Index m,
+                         const Ipopt::Number* g, const Ipopt::Number* lambda,
+                         Ipopt::Number obj_value,
+                         const Ipopt::IpoptData* ip_data,
+                         Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+  // Polynomial coefficients and cost weights of the next solve
+  void SetParams(const double* coeffs, const MPCWeights& weights);
+
+  // Takes up the parameters and forgets the last solve; call before each
+  // solve
+  void Prepare();
+
+  bool Analytic() const { return analytic; }
+  Ipopt::SolverReturn Status() const { return status; }
+  double ObjValue() const { return obj_value; }
+  int Iterations() const { return iterations; }
+
+ private:
+  // Copies x followed by the parameters into the tape's argument
+  void setPoint(const Ipopt::Number* x);
+
+  // Evaluates fg at x unless it was already evaluated there
+  void evaluate(const Ipopt::Number* x, bool new_x);
+
+  // Variables, constraints, polynomial coefficients and parameters: the
+  // coefficients followed by the ten fields of MPCWeights
+  static const size_t n = MPCLayout<N, DtMs>::n_vars;
+  static const size_t m = MPCLayout<N, DtMs>::n_constraints;
+  static const size_t n_coeffs = 4;
+  static const size_t n_params = n_coeffs + 10;
+
+  Dvector params;
+  MPCWeights cost_weights;
+
+  bool analytic;
+
+  FG_analytic<N, DtMs> fg_analytic;
+
+  CppAD::ADFun<double> fun;
+  std::vector<std::set<size_t> > jac_pattern;
+  std::vector<std::set<size_t> > hes_pattern;
+  std::vector<size_t> jac_row;
+  std::vector<size_t> jac_col;
+  std::vector<size_t> hes_row;
+  std::vector<size_t> hes_col;
+  CppAD::sparse_jacobian_work jac_work;
+  CppAD::sparse_hessian_work hes_work;
+
+  // Evaluation buffers
+  Dvector x;
+  Dvector fg;
+  Dvector weights;
+  Dvector cost_weight;
+  Dvector jac_values;
+  Dvector hes_values;
+
+  Ipopt::SolverReturn status;
+  double obj_value;
+  int iterations;
+};
+
+#endif /* MPC_NLP_H */
@@ -0,0 +1,234 @@
+#include "mpc_qp.h"
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Cholesky"
+
+template <int N, int DtMs>
+QPBackend<N, DtMs>::QPBackend()
+    : max_sqp_iterations(3), max_qp_iterations(30),
+      cost_gradient(Layout::n_vars), trial(Layout::n_vars) {
+  free_index.reserve(n_inputs);
+}
+
+template <int N, int DtMs>
+void QPBackend<N, DtMs>::setWeights(const MPCWeights& weights) {
+  fg_analytic.SetWeights(weights);
+  state_weights << 2 * weights.v, 2 * weights.cte, 2 * weights.epsi;
+
+  // The magnitude and the squared changes between consecutive steps, in the
+  // order of the variables: the N - 1 deltas, then the N - 1 a
+  hessian_inputs.setZero();
+  const double magnitude[] = {2 * weights.delta, 2 * weights.a};
+  const double rate[] = {2 * weights.delta_rate, 2 * weights.a_rate};
+  for (int k = 0; k < 2; k++) {
+    int block = k * (N - 1);
+    for (int i = 0; i < N - 1; i++) {
+      hessian_inputs(block + i, block + i) = magnitude[k];
+    }
+    for (int i = 0; i < N - 2; i++) {
+      hessian_inputs(block + i, block + i) += rate[k];
+      hessian_inputs(block + i + 1, block + i + 1) += rate[k];
+      hessian_inputs(block + i, block + i + 1) = -rate[k];
+      hessian_inputs(block + i + 1, block + i) = -rate[k];
+    }
+  }
+}
+
+template <int N, int DtMs>
+void QPBackend<N, DtMs>::condense(const Eigen::VectorXd& coeffs,
+                                  const std::vector<double>& vars) {
+  constexpr double dt = Layout::dt;
+
+  // Sensitivity of the state at step i + 1 to all actuations, from that of
+  // step i: S[i+1] = A[i] S[i] + B[i] for the actuations of step i. The state
+  // at step 0 is fixed.
+  Eigen::Matrix<double, 6, n_inputs> S;
+  S.setZero();
+  Eigen::Matrix<double, 6, 6> A;
+  for (int i = 0; i < N - 1; i++) {
+    double x0 = vars[Layout::x_start + i];
+    double psi0 = vars[Layout::psi_start + i];
+    double v0 = vars[Layout::v_start + i];
+    double epsi0 = vars[Layout::epsi_start + i];
+    double delta0 = vars[Layout::delta_start + i];
+
+    double slope = coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * x0 * x0;
+    double curvature = 2 * coeffs[2] + 6 * coeffs[3] * x0;
+
+    // Jacobian of the model step in [x, y, psi, v, cte, epsi]
+    A.setZero();
+    A(0, 0) = 1;
+    A(0, 2) = -v0 * sin(psi0) * dt;
+    A(0, 3) = cos(psi0) * dt;
+    A(1, 1) = 1;
+    A(1, 2) = v0 * cos(psi0) * dt;
+    A(1, 3) = sin(psi0) * dt;
+    A(2, 2) = 1;
+    A(2, 3) = -delta0 / Lf * dt;
+    A(3, 3) = 1;
+    A(4, 0) = slope;
+    A(4, 1) = -1;
+    A(4, 3) = sin(epsi0) * dt;
+    A(4, 5) = v0 * cos(epsi0) * dt;
+    A(5, 0) = -curvature / (1 + slope * slope);
+    A(5, 2) = 1;
+    A(5, 3) = -delta0 / Lf * dt;
+
+    S = A * S;
+    // Columns of the actuations of step i
+    S(2, i) -= v0 / Lf * dt;
+    S(5, i) -= v0 / Lf * dt;
+    S(3, N - 1 + i) += dt;
+
+    // Only v, cte and epsi enter the cost
+    sensitivity.middleRows(3 * i, 3) = S.middleRows(3, 3);
+  }
+}
+
+template <int N, int DtMs>
+int QPBackend<N, DtMs>::solveBoxQP() {
+  step.setZero();
+  double value = 0;
+  int iterations = 0;
+  while (iterations < max_qp_iterations) {
+    iterations++;
+    qp_gradient.noalias() = hessian * step;
+    qp_gradient += gradient;
+
+    // Variables not held at a bound by the gradient, and the largest gradient
+    // among them; it vanishes at the minimum
+    free_index.clear();
+    double largest = 0;
+    for (int j = 0; j < n_inputs; j++) {
+      bool at_lower = step[j] <= lower[j] && qp_gradient[j] > 0;
+      bool at_upper = step[j] >= upper[j] && qp_gradient[j] < 0;
+      if (!at_lower && !at_upper) {
+        free_index.push_back(j);
+        largest = std::max(largest, fabs(qp_gradient[j]));
+      }
+    }
+    if (largest < 1e-9) {
+      break;
+    }
+
+    // Newton direction in the free variables. The Hessian is positive
+    // definite as long as the actuation magnitudes have positive weights;
+    // give up on the QP where it is not.
+    int n_free = free_index.size();
+    free_hessian.resize(n_free, n_free);
+    free_gradient.resize(n_free);
+    for (int r = 0; r < n_free; r++) {
+      free_gradient[r] = qp_gradient[free_index[r]];
+      for (int c = 0; c < n_free; c++) {
+        free_hessian(r, c) = hessian(free_index[r], free_index[c]);
+      }
+    }
+    Eigen::LLT<FreeMatrix> llt(free_hessian);
+    if (llt.info() != Eigen::Success) {
+      break;
+    }
+    free_gradient = llt.solve(free_gradient);
+    qp_direction.setZero();
+    for (int r = 0; r < n_free; r++) {
+      qp_direction[free_index[r]] = -free_gradient[r];
+    }
+
+    // Backtrack along the direction projected onto the bounds
+    double t = 1;
+    double trial_value = value;
+    for (int k = 0; k < 20; k++, t *= 0.5) {
+      qp_trial = (step + t * qp_direction).cwiseMax(lower).cwiseMin(upper);
+      trial_value = 0.5 * qp_trial.dot(hessian * qp_trial) + gradient.dot(qp_trial);
+      if (trial_value <= value + 1e-4 * qp_gradient.dot(qp_trial - step)) {
+        break;
+      }
+    }
+    if (trial_value >= value) {
+      break;
+    }
+    step = qp_trial;
+    value = trial_value;
+  }
+  return iterations;
+}
+
+template <int N, int DtMs>
+void QPBackend<N, DtMs>::Solve(const Eigen::VectorXd& coeffs,
+                               const MPCWeights& weights, bool warm,
+                               std::vector<double>& vars,
+                               MPCSolveStats& stats) {
+  fg_analytic.SetCoeffs(coeffs.data());
+  setWeights(weights);
+
+  // Any guess becomes feasible by clamping the actuations and simulating
+  // the states they lead to
+  for (int j = 0; j < n_inputs; j++) {
+    double limit = j < N - 1 ? max_delta : max_a;
+    double& u = vars[Layout::delta_start + j];
+    u = std::max(-limit, std::min(limit, u));
+  }
+  rollout<N, DtMs>(coeffs, vars);
+  double cost = fg_analytic.Cost(vars.data());
+
+  int iterations = 0;
+  while (iterations < max_sqp_iterations) {
+    iterations++;
+
+    // Gauss-Newton model of the cost in the actuation step
+    condense(coeffs, vars);
+    fg_analytic.CostGradient(vars.data(), cost_gradient.data());
+    for (int i = 0; i < N - 1; i++) {
+      state_gradient[3*i] = cost_gradient[Layout::v_start + i + 1];
+      state_gradient[3*i + 1] = cost_gradient[Layout::cte_start + i + 1];
+      state_gradient[3*i + 2] = cost_gradient[Layout::epsi_start + i + 1];
+    }
+    gradient = Eigen::Map<const InputVector>(cost_gradient.data() +
+                                             Layout::delta_start);
+    gradient.noalias() += sensitivity.transpose() * state_gradient;
+    hessian = hessian_inputs;
+    hessian.noalias() +=
+        sensitivity.transpose() * state_weights.replicate<N - 1, 1>().asDiagonal() *
+        sensitivity;
+    for (int j = 0; j < n_inputs; j++) {
+      double limit = j < N - 1 ? max_delta : max_a;
+      lower[j] = -limit - vars[Layout::delta_start + j];
+      upper[j] = limit - vars[Layout::delta_start + j];
+    }
+
+    solveBoxQP();
+    double decrease = gradient.dot(step);
+    if (decrease > -1e-9) {
+      break;
+    }
+
+    // The model is only exact to first order in the states, so take the
+    // longest fraction of the step that lowers the true cost enough
+    bool accepted = false;
+    double t = 1;
+    for (int k = 0; k < 10; k++, t *= 0.5) {
+      trial = vars;
+      for (int j = 0; j < n_inputs; j++) {
+        trial[Layout::delta_start + j] += t * step[j];
+      }
+      rollout<N, DtMs>(coeffs, trial);
+      double trial_cost = fg_analytic.Cost(trial.data());
+      if (trial_cost <= cost + 1e-4 * t * decrease) {
+        vars.swap(trial);
+        cost = trial_cost;
+        accepted = true;
+        break;
+      }
+    }
+    if (!accepted || t * step.cwiseAbs().maxCoeff() < 1e-6) {
+      break;
+    }
+  }
+
+  stats.success = std::isfinite(cost);
+  stats.iterations = iterations;
+  stats.cost = cost;
+}
+
+// Definitions for each horizon of MPC_HORIZONS
+#define INSTANTIATE_QP(N, DtMs) template class QPBackend<N, DtMs>;
+MPC_HORIZONS(INSTANTIATE_QP)
@@ -0,0 +1,91 @@
+#ifndef MPC_QP_H
+#define MPC_QP_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "mpc_backend.h"
+#include "mpc_model.h"
+
+//
+// Real-time sequential quadratic programming backend. Every iteration
+// linearizes the model around the current trajectory, condenses the states
+// out (each state is the initial state plus a linear function of the
+// actuations), and solves the remaining dense QP in the 2 (N - 1) actuations
+// with their box constraints. The cost is quadratic in the states, so the QP
+// is its exact Gauss-Newton model. The trajectory is always a rollout of the
+// actuations, so it satisfies the model constraints exactly, and each step is
+// only accepted if it lowers the cost.
+//
+// Both iteration counts are capped, and all matrices have the fixed sizes of
+// the horizon, which bounds the work per control cycle. Warm started on the
+// lake track, an uncapped solve takes 3 to 4 iterations. The last one usually
+// only confirms that no step lowers the cost. So nearly every cycle reaches
+// the default cap of 3.
+//
+template <int N, int DtMs = 100>
+class QPBackend : public MPCBackend {
+ public:
+  typedef MPCLayout<N, DtMs> Layout;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  QPBackend();
+
+  // Linearize / QP / line search rounds per solve
+  int max_sqp_iterations;
+  // Projected Newton iterations per QP
+  int max_qp_iterations;
+
+  // Keeps nothing between solves: a warm start is all in the guess
+  void Solve(const Eigen::VectorXd& coeffs, const MPCWeights& weights,
+             bool warm, std::vector<double>& vars, MPCSolveStats& stats);
+
+ private:
+  static const int n_inputs = Layout::n_inputs;
+  typedef Eigen::Matrix<double, n_inputs, n_inputs> InputMatrix;
+  typedef Eigen::Matrix<double, n_inputs, 1> InputVector;
+  // v, cte and epsi at steps 1 .. N-1
+  typedef Eigen::Matrix<double, 3 * (N - 1), 1> StateVector;
+  // Subproblem in the variables off their bounds, at most all of them
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, n_inputs,
+                        n_inputs> FreeMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, n_inputs, 1> FreeVector;
+
+  // Sensitivities of v, cte and epsi at steps 1 .. N-1 (3 rows per step) to
+  // the actuations, at the current trajectory
+  void condense(const Eigen::VectorXd& coeffs, const std::vector<double>& vars);
+
+  // Takes up the cost weights: hessian_inputs and state_weights
+  void setWeights(const MPCWeights& weights);
+
+  // Minimizes 0.5 du' H du + g' du over lower <= du <= upper, starting at
+  // du = 0; returns the iterations taken
+  int solveBoxQP();
+
+  FG_analytic<N, DtMs> fg_analytic;
+
+  // Cost Hessian of the actuations alone: magnitude and rate terms
+  InputMatrix hessian_inputs;
+  // Cost Hessian of v, cte and epsi, the diagonal of one step
+  Eigen::Vector3d state_weights;
+
+  Eigen::Matrix<double, 3 * (N - 1), n_inputs> sensitivity;
+  InputMatrix hessian;
+  InputVector gradient;
+  InputVector lower;
+  InputVector upper;
+  InputVector step;
+
+  // Buffers of solveBoxQP and the line search
+  InputVector qp_gradient;
+  InputVector qp_trial;
+  InputVector qp_direction;
+  std::vector<int> free_index;
+  FreeMatrix free_hessian;
+  FreeVector free_gradient;
+  StateVector state_gradient;
+  std::vector<double> cost_gradient;
+  std::vector<double> trial;
+};
+
+#endif /* MPC_QP_H */
@@ -0,0 +1,142 @@
+// Drives the controller around a waypoint track in the offline closed loop of
+// simulator.h and reports lap times, cross-track error and solve latency. The
+// exit status is non-zero if the vehicle leaves the track, so the run can gate
+// CI.
+//
+// Usage: mpc_sim [--laps N] [--latency MS] [--period MS] [--horizon 5|10|20]
+//                [--spline] [--preview S] [--lateral A] [--ipopt] [TRACK]
+//
+// TRACK defaults to ../lake_track_waypoints.csv, the track of this project
+// seen from the build directory. The QP backend is used unless --ipopt is
+// given, which needs a build with Ipopt. --spline fits the reference to the
+// track spline over the next --preview seconds instead of to the waypoints the
+// simulator would send, and --lateral caps the reference speed ahead of curves
+// to keep the lateral acceleration below A.
+
+#include <math.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "simulator.h"
+
+template <int N>
+static void run(const Track &track, const SimConfig &cfg,
+                MPCSolverType solver_type, SimResult &result) {
+  MPC<N> mpc;
+  mpc.solver_type = solver_type;
+  mpc.analytic_derivatives = true;
+  simulate(track, cfg, mpc, result);
+}
+
+int main(int argc, char *argv[]) {
+  SimConfig cfg;
+  std::string file = "../lake_track_waypoints.csv";
+  int horizon = 10;
+  MPCSolverType solver_type = MPC_SOLVER_QP;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--laps") == 0 && has_value) {
+      cfg.laps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--latency") == 0 && has_value) {
+      cfg.latency = atof(argv[++i]) / 1000;
+    } else if (strcmp(argv[i], "--period") == 0 && has_value) {
+      cfg.period = atof(argv[++i]) / 1000;
+    } else if (strcmp(argv[i], "--horizon") == 0 && has_value) {
+      horizon = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--spline") == 0) {
+      cfg.spline_reference = true;
+    } else if (strcmp(argv[i], "--preview") == 0 && has_value) {
+      cfg.preview = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--lateral") == 0 && has_value) {
+      cfg.max_lateral_accel = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--ipopt") == 0) {
+#ifdef MPC_IPOPT
+      solver_type = MPC_SOLVER_IPOPT;
+#else
+      // MPC would quietly fall back to the QP backend
+      std::cerr << "--ipopt is not available, built with MPC_IPOPT=OFF"
+                << std::endl;
+      return -1;
+#endif
+    } else if (argv[i][0] != '-') {
+      file = argv[i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--laps N] [--latency MS]"
+                << " [--period MS] [--horizon 5|10|20] [--spline]"
+                << " [--preview S] [--lateral A] [--ipopt] [TRACK]"
+                << std::endl;
+      return -1;
+    }
+  }
+
+  Track track;
+  if (!track.Load(file)) {
+    std::cerr << "Failed to load track " << file << std::endl;
+    return -1;
+  }
+
+  SimResult result;
+  if (horizon == 5) {
+    run<5>(track, cfg, solver_type, result);
+  } else if (horizon == 10) {
+    run<10>(track, cfg, solver_type, result);
+  } else if (horizon == 20) {
+    run<20>(track, cfg, solver_type, result);
+  } else {
+    std::cerr << "Horizon must be 5, 10 or 20" << std::endl;
+    return -1;
+  }
+
+  printf("track %s: %d waypoints, %.0f m\n", file.c_str(), track.Size(),
+         track.Length());
+  printf("%s backend, N = %d, latency %.0f ms, period %.0f ms, %s\n",
+         solver_type == MPC_SOLVER_QP ? "qp" : "ipopt", horizon,
+         cfg.latency * 1000, cfg.period * 1000,
+         cfg.spline_reference ? "spline reference" : "waypoint reference");
+  for (size_t k = 0; k < result.lap_time.size(); k++) {
+    printf("lap %zu: %.1f s\n", k + 1, result.lap_time[k]);
+  }
+  printf("%.1f s simulated in %.0f ms (%.0fx real time), mean speed %.1f\n",
+         result.sim_time, result.wall_ms,
+         result.sim_time * 1000 / std::max(result.wall_ms, 1e-3),
+         result.mean_speed);
+
+  std::vector<double> cte = result.cte;
+  double cte_sum = 0;
+  double cte_square_sum = 0;
+  for (size_t k = 0; k < cte.size(); k++) {
+    cte_sum += cte[k];
+    cte_square_sum += cte[k] * cte[k];
+  }
+  std::sort(cte.begin(), cte.end());
+  printf("|cte| [m]: mean %.3f, rms %.3f, p50 %.3f, p99 %.3f, max %.3f\n",
+         cte.empty() ? 0 : cte_sum / cte.size(),
+         cte.empty() ? 0 : sqrt(cte_square_sum / cte.size()),
+         percentile(cte, 0.5), percentile(cte, 0.99),
+         cte.empty() ? 0 : cte.back());
+
+  std::vector<double> solve_ms = result.solve_ms;
+  std::vector<double> iterations = result.iterations;
+  double iteration_sum = 0;
+  for (size_t k = 0; k < iterations.size(); k++) {
+    iteration_sum += iterations[k];
+  }
+  std::sort(solve_ms.begin(), solve_ms.end());
+  printf("solve [ms]: p50 %.3f, p99 %.3f, max %.3f over %zu cycles, "
+         "%.1f iterations on average, %d failed\n",
+         percentile(solve_ms, 0.5), percentile(solve_ms, 0.99),
+         solve_ms.empty() ? 0 : solve_ms.back(), solve_ms.size(),
+         iterations.empty() ? 0 : iteration_sum / iterations.size(),
+         result.failed);
+
+  if (!result.completed) {
+    std::cerr << "Left the track after " << result.sim_time << " s"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
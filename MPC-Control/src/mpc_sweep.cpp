@@ -0,0 +1,247 @@
+// Tunes the cost weights of MPCWeights: drives a lap of the offline closed
+// loop of simulator.h with each of many random weight sets, spread over all
+// cores, and ranks them by cross-track error and lap time.
+//
+// Usage: mpc_sweep [--sets N] [--threads N] [--laps N] [--latency MS]
+//                  [--seed N] [--top N] [--time-weight W] [--csv FILE]
+//                  [TRACK]
+//
+// Set 0 is the defaults of MPCWeights, so its rank shows what the sweep
+// gained. The score of a set that completes its laps is its RMS cross-track
+// error over that of the defaults plus W (1 by default) times its first lap
+// time over that of the defaults, so the defaults score 1 + W and a set that
+// halves the error by crawling does not win. The ranking only depends on the
+// simulated runs, not on solve times, so it is the same for any number of
+// threads. The others scale each weight of the defaults by a log-uniform
+// factor in [0.1, 10] and draw the reference speed from [15, 30]; the seed
+// makes a sweep repeatable.
+//
+// Every worker thread owns one controller on the QP backend and runs the sets
+// it takes one after the other. The QP backend and the model keep all of
+// their state in the controller. The Ipopt backend is not offered: neither
+// the CppAD tape recording nor MUMPS, Ipopt's linear solver, may run in more
+// than one thread at a time.
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+#include "simulator.h"
+
+namespace {
+
+// Outcome of one weight set
+struct Trial {
+  MPCWeights weights;
+  bool completed;
+  double lap_time;  // Of the first lap, 0 if none was completed [s]
+  double distance;  // Driven before the end of the run [m]
+  double cte_rms;   // [m]
+  double cte_max;   // [m]
+  double solve_p50; // [ms]
+  double solve_p99; // [ms]
+  double score;     // Lower is better, for completed runs
+};
+
+// Completed runs first, by score, the others by how far they got. Ties keep
+// the order of the sets.
+bool better(const Trial &a, const Trial &b) {
+  if (a.completed != b.completed) {
+    return a.completed;
+  }
+  if (!a.completed) {
+    return a.distance > b.distance;
+  }
+  return a.score < b.score;
+}
+
+void run(const Track &track, const SimConfig &cfg, MPC<10> &mpc,
+         Trial &trial) {
+  // Nothing carries over from the previous set
+  mpc.weights = trial.weights;
+  mpc.Reset();
+  mpc.prev_delta = 0;
+  mpc.prev_a = 0;
+  SimResult result;
+  simulate(track, cfg, mpc, result);
+
+  double cte_square_sum = 0;
+  for (size_t k = 0; k < result.cte.size(); k++) {
+    cte_square_sum += result.cte[k] * result.cte[k];
+  }
+  std::vector<double> solve_ms = result.solve_ms;
+  std::sort(solve_ms.begin(), solve_ms.end());
+
+  trial.completed = result.completed;
+  trial.lap_time = result.lap_time.empty() ? 0 : result.lap_time[0];
+  trial.distance = result.mean_speed * result.sim_time;
+  trial.cte_rms = result.cte.empty()
+                      ? 0 : sqrt(cte_square_sum / result.cte.size());
+  trial.cte_max = result.cte.empty()
+                      ? 0 : *std::max_element(result.cte.begin(),
+                                              result.cte.end());
+  trial.solve_p50 = percentile(solve_ms, 0.5);
+  trial.solve_p99 = percentile(solve_ms, 0.99);
+}
+
+void print(int rank, int set, const Trial &t) {
+  const MPCWeights &w = t.weights;
+  printf("%4d %4d %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %5.1f | %-3s "
+         "%5.2f %6.1f %6.3f %6.3f %7.3f %7.3f\n",
+         rank, set, w.cte, w.epsi, w.v, w.delta, w.a, w.delta_rate, w.a_rate,
+         w.ref_v, t.completed ? "yes" : "no", t.score, t.lap_time, t.cte_rms,
+         t.cte_max, t.solve_p50, t.solve_p99);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  SimConfig cfg;
+  std::string file = "../lake_track_waypoints.csv";
+  std::string csv;
+  int sets = 200;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  int top = 10;
+  double time_weight = 1;
+  unsigned seed = 1;
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--sets") == 0 && has_value) {
+      sets = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--laps") == 0 && has_value) {
+      cfg.laps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--latency") == 0 && has_value) {
+      cfg.latency = atof(argv[++i]) / 1000;
+    } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+      seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--top") == 0 && has_value) {
+      top = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--time-weight") == 0 && has_value) {
+      time_weight = std::max(0.0, atof(argv[++i]));
+    } else if (strcmp(argv[i], "--csv") == 0 && has_value) {
+      csv = argv[++i];
+    } else if (argv[i][0] != '-') {
+      file = argv[i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--sets N] [--threads N]"
+                << " [--laps N] [--latency MS] [--seed N] [--top N]"
+                << " [--time-weight W] [--csv FILE] [TRACK]" << std::endl;
+      return -1;
+    }
+  }
+
+  Track track;
+  if (!track.Load(file)) {
+    std::cerr << "Failed to load track " << file << std::endl;
+    return -1;
+  }
+
+  std::vector<Trial> trials(sets);
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> exponent(-1, 1);
+  std::uniform_real_distribution<double> speed(15, 30);
+  for (int k = 1; k < sets; k++) {
+    MPCWeights &w = trials[k].weights;
+    double *scaled[] = {&w.cte, &w.epsi, &w.v, &w.delta, &w.a,
+                        &w.delta_rate, &w.a_rate};
+    for (double *weight : scaled) {
+      *weight *= pow(10, exponent(gen));
+    }
+    w.ref_v = speed(gen);
+  }
+
+  // Workers take the next set until none is left
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  threads = std::min(threads, sets);
+  for (int t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&]() {
+      MPC<10> mpc;
+      mpc.solver_type = MPC_SOLVER_QP;
+      for (int k = next++; k < sets; k = next++) {
+        run(track, cfg, mpc, trials[k]);
+      }
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+  double wall_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  // Scores relative to the defaults, or to the first set that completed if
+  // they did not
+  const Trial *reference = &trials[0];
+  for (int k = 0; k < sets && !reference->completed; k++) {
+    reference = &trials[k];
+  }
+  for (int k = 0; k < sets; k++) {
+    Trial &t = trials[k];
+    t.score = t.completed
+                  ? t.cte_rms / std::max(reference->cte_rms, 1e-9) +
+                        time_weight * t.lap_time /
+                            std::max(reference->lap_time, 1e-9)
+                  : 0;
+  }
+
+  std::vector<int> order(sets);
+  for (int k = 0; k < sets; k++) {
+    order[k] = k;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return better(trials[a], trials[b]);
+  });
+
+  int completed = 0;
+  for (int k = 0; k < sets; k++) {
+    completed += trials[k].completed ? 1 : 0;
+  }
+  printf("track %s, N = 10, qp backend, latency %.0f ms, %d lap(s), "
+         "time weight %.2f\n",
+         file.c_str(), cfg.latency * 1000, cfg.laps, time_weight);
+  printf("%d weight sets on %d threads in %.1f s, %d completed\n\n", sets,
+         threads, wall_s, completed);
+  printf("rank  set    cte   epsi      v  delta      a  d_rate a_rate ref_v "
+         "| ok  score lap[s] cte_rms cte_max p50[ms] p99[ms]\n");
+  for (int r = 0; r < std::min(top, sets); r++) {
+    print(r + 1, order[r], trials[order[r]]);
+  }
+  int default_rank =
+      std::find(order.begin(), order.end(), 0) - order.begin() + 1;
+  if (default_rank > top) {
+    printf("...\n");
+    print(default_rank, 0, trials[0]);
+  }
+
+  if (!csv.empty()) {
+    std::ofstream out(csv.c_str());
+    out << "rank,set,cte,epsi,v,delta,a,delta_rate,a_rate,ref_cte,ref_epsi,"
+           "ref_v,completed,score,lap_time,cte_rms,cte_max,solve_p50,"
+           "solve_p99\n";
+    for (int r = 0; r < sets; r++) {
+      const Trial &t = trials[order[r]];
+      const MPCWeights &w = t.weights;
+      out << r + 1 << "," << order[r] << "," << w.cte << "," << w.epsi << ","
+          << w.v << "," << w.delta << "," << w.a << "," << w.delta_rate << ","
+          << w.a_rate << "," << w.ref_cte << "," << w.ref_epsi << ","
+          << w.ref_v << "," << t.completed << "," << t.score << ","
+          << t.lap_time << ","
+          << t.cte_rms << "," << t.cte_max << "," << t.solve_p50 << ","
+          << t.solve_p99 << "\n";
+    }
+  }
+  return 0;
+}
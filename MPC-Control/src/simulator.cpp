@@ -0,0 +1,205 @@
+#include "simulator.h"
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include "mpc_model.h"
+#include "telemetry.h"
+
+bool Track::Load(const std::string& file) {
+  std::ifstream in(file.c_str());
+  if (!in) {
+    return false;
+  }
+  x.clear();
+  y.clear();
+  std::string line;
+  std::getline(in, line);  // x,y
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    double px, py;
+    char comma;
+    if (fields >> px >> comma >> py) {
+      x.push_back(px);
+      y.push_back(py);
+    }
+  }
+  if (x.size() < 3) {
+    return false;
+  }
+
+  s.resize(x.size());
+  s[0] = 0;
+  for (int i = 1; i < Size(); i++) {
+    s[i] = s[i - 1] + hypot(x[i] - x[i - 1], y[i] - y[i - 1]);
+  }
+  length = s.back() + hypot(x[0] - x.back(), y[0] - y.back());
+  return spline.Build(x, y);
+}
+
+void Track::Project(double px, double py, int& segment, double& cte,
+                    double& s) const {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < Size(); i++) {
+    int j = (i + 1) % Size();
+    double dx = x[j] - x[i];
+    double dy = y[j] - y[i];
+    double segment_length = hypot(dx, dy);
+    // Fraction of the segment the closest point lies at
+    double t = ((px - x[i]) * dx + (py - y[i]) * dy) /
+               (segment_length * segment_length);
+    t = std::max(0.0, std::min(1.0, t));
+    double ex = px - (x[i] + t * dx);
+    double ey = py - (y[i] + t * dy);
+    double distance = hypot(ex, ey);
+    if (distance < best) {
+      best = distance;
+      segment = i;
+      // Left of the direction of travel is positive
+      cte = (dx * ey - dy * ex) > 0 ? distance : -distance;
+      s = this->s[i] + t * segment_length;
+    }
+  }
+}
+
+double percentile(const std::vector<double>& sorted, double q) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = std::min(sorted.size() - 1, size_t(q * sorted.size()));
+  return sorted[i];
+}
+
+namespace {
+
+// Command waiting for its latency to pass
+struct Command {
+  double time;
+  double delta;
+  double a;
+};
+
+}  // namespace
+
+template <int N, int DtMs>
+void simulate(const Track& track, const SimConfig& cfg, MPC<N, DtMs>& mpc,
+              SimResult& result) {
+  auto wall_start = std::chrono::steady_clock::now();
+  result = SimResult();
+  result.completed = false;
+
+  // Vehicle state and the actuations in effect
+  double x = track.x[0];
+  double y = track.y[0];
+  double psi = atan2(track.y[1] - track.y[0], track.x[1] - track.x[0]);
+  double v = 0;
+  double delta = 0;
+  double a = 0;
+
+  std::deque<Command> pending;
+  Telemetry telemetry;
+  ControlInput input;
+  double t = 0;
+  double next_control = 0;
+  double lap_start = 0;
+  double travelled = 0;
+  double speed_sum = 0;
+  int segment;
+  double cte, s;
+  track.Project(x, y, segment, cte, s);
+  double prev_s = s;
+  double spline_s = -1;
+  double ref_v = mpc.weights.ref_v;
+
+  while (int(result.lap_time.size()) < cfg.laps) {
+    if (t >= next_control) {
+      telemetry.x = x;
+      telemetry.y = y;
+      if (cfg.spline_reference) {
+        double curvature =
+            splineWaypoints(track.spline, cfg.preview, spline_s, telemetry);
+        if (cfg.max_lateral_accel > 0) {
+          mpc.weights.ref_v = std::min(
+              ref_v, sqrt(cfg.max_lateral_accel / std::max(curvature, 1e-9)));
+        }
+      } else {
+        // Waypoints around the vehicle, as the simulator sends them
+        telemetry.ptsx.clear();
+        telemetry.ptsy.clear();
+        for (int k = -cfg.waypoints_behind; k <= cfg.waypoints_ahead; k++) {
+          int i = ((segment + k) % track.Size() + track.Size()) % track.Size();
+          telemetry.ptsx.push_back(track.x[i]);
+          telemetry.ptsy.push_back(track.y[i]);
+        }
+      }
+      telemetry.psi = psi;
+      telemetry.speed = v;
+      telemetry.steering_angle = delta;
+      telemetry.throttle = a;
+      if (cfg.record_telemetry) {
+        result.telemetry.push_back(telemetry);
+      }
+
+      prepareControlInput(telemetry, mpc.prev_a, cfg.latency, input);
+      vector<double> command = mpc.Solve(input.state, input.coeffs);
+      mpc.prev_a = command[1];
+
+      const MPCSolveStats& stats = mpc.LastSolve();
+      result.solve_ms.push_back(stats.solve_ms);
+      result.iterations.push_back(stats.iterations);
+      result.failed += stats.success ? 0 : 1;
+
+      Command pending_command = {t + cfg.latency, command[0], command[1]};
+      pending.push_back(pending_command);
+      next_control += cfg.period;
+    }
+    while (!pending.empty() && pending.front().time <= t) {
+      delta = pending.front().delta;
+      a = pending.front().a;
+      pending.pop_front();
+    }
+
+    // The kinematic model the controller plans with
+    x += v * cos(psi) * cfg.step;
+    y += v * sin(psi) * cfg.step;
+    psi -= v * delta / Lf * cfg.step;
+    v += a * cfg.step;
+    t += cfg.step;
+
+    track.Project(x, y, segment, cte, s);
+    double ds = s - prev_s;
+    if (ds < -track.Length() / 2) {
+      ds += track.Length();
+    } else if (ds > track.Length() / 2) {
+      ds -= track.Length();
+    }
+    travelled += ds;
+    prev_s = s;
+    result.cte.push_back(fabs(cte));
+    speed_sum += v;
+
+    if (fabs(cte) > cfg.max_cte || t - lap_start > cfg.lap_limit) {
+      break;
+    }
+    if (travelled >= track.Length() * (result.lap_time.size() + 1)) {
+      result.lap_time.push_back(t - lap_start);
+      lap_start = t;
+    }
+  }
+
+  mpc.weights.ref_v = ref_v;
+  result.completed = int(result.lap_time.size()) == cfg.laps;
+  result.sim_time = t;
+  result.mean_speed = result.cte.empty() ? 0 : speed_sum / result.cte.size();
+  result.wall_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - wall_start).count();
+}
+
+// Definitions for each horizon of MPC_HORIZONS
+#define INSTANTIATE_SIMULATE(N, DtMs)                                     \
+  template void simulate<N, DtMs>(const Track& track, const SimConfig& cfg, \
+                                  MPC<N, DtMs>& mpc, SimResult& result);
+MPC_HORIZONS(INSTANTIATE_SIMULATE)
@@ -0,0 +1,90 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "telemetry.h"
+#include "track_spline.h"
+
+//
+// Offline closed loop: the kinematic model of mpc_model.h driven around a
+// waypoint track by the controller, in simulated time. The controller gets
+// the same Telemetry the simulator sends, and its commands take effect after
+// the configured latency. Nothing waits on the wall clock, so a lap takes a
+// fraction of a second.
+//
+
+// Closed polyline through the waypoints of a track file such as
+// lake_track_waypoints.csv, driven in the order of the waypoints.
+class Track {
+ public:
+  // Reads the "x,y" header and one waypoint per line; false on failure
+  bool Load(const std::string& file);
+
+  int Size() const { return int(x.size()); }
+  double Length() const { return length; }
+
+  // Closest point of the track to (px, py): the waypoint it follows, its
+  // signed distance (positive left of the track) and arc length from the
+  // first waypoint
+  void Project(double px, double py, int& segment, double& cte,
+               double& s) const;
+
+  std::vector<double> x;
+  std::vector<double> y;
+  // Arc length of each waypoint from the first
+  std::vector<double> s;
+  // Smooth reference through the waypoints, built by Load
+  TrackSpline spline;
+
+ private:
+  double length;
+};
+
+// Settings of a closed-loop run
+struct SimConfig {
+  int laps = 1;
+  double latency = 0.1;     // From telemetry to the command taking effect [s]
+  double period = 0.1;      // Between telemetry events [s]
+  double step = 0.01;       // Integration step of the vehicle [s]
+  double max_cte = 5;       // The vehicle left the track beyond this [m]
+  double lap_limit = 300;   // Gives up on a lap after this long [s]
+  int waypoints_behind = 1; // Waypoints sent in telemetry around the vehicle
+  int waypoints_ahead = 4;
+  // Waypoints from Track::spline over the horizon (splineWaypoints) instead
+  // of the track waypoints around the vehicle
+  bool spline_reference = false;
+  double preview = 1.5;     // Time the spline waypoints reach ahead [s]
+  // With the spline reference, lowers the reference speed ahead of curves so
+  // the lateral acceleration v^2 |curvature| stays below this; 0 for none
+  double max_lateral_accel = 0;
+  // Keeps every event sent to the controller in SimResult::telemetry
+  bool record_telemetry = false;
+};
+
+// Outcome of a closed-loop run
+struct SimResult {
+  bool completed;               // All laps driven without leaving the track
+  std::vector<double> lap_time; // Simulated [s]
+  double sim_time;              // Simulated [s]
+  double wall_ms;               // Wall time of the whole run [ms]
+  std::vector<double> cte;      // |cte| per integration step [m]
+  double mean_speed;
+  std::vector<double> solve_ms; // Per control cycle
+  std::vector<double> iterations;
+  int failed;                   // Solves that did not succeed
+  // Events of every control cycle, with SimConfig::record_telemetry
+  std::vector<Telemetry> telemetry;
+};
+
+// Drives cfg.laps laps of the track from standstill at its first waypoint.
+// The controller is used as is, set it up (backend, warm start) beforehand.
+template <int N, int DtMs>
+void simulate(const Track& track, const SimConfig& cfg, MPC<N, DtMs>& mpc,
+              SimResult& result);
+
+// Value below which a fraction q of the sorted values lies
+double percentile(const std::vector<double>& sorted, double q);
+
+#endif /* SIMULATOR_H */
@@ -0,0 +1,121 @@
+#include "telemetry.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "mpc_model.h"
+
+void parseTelemetry(const nlohmann::json& data, Telemetry& telemetry) {
+  telemetry.ptsx = data["ptsx"].get<std::vector<double> >();
+  telemetry.ptsy = data["ptsy"].get<std::vector<double> >();
+  telemetry.x = data["x"];
+  telemetry.y = data["y"];
+  telemetry.psi = data["psi"];
+  telemetry.speed = data["speed"];
+  telemetry.steering_angle = data["steering_angle"];
+  telemetry.throttle = data["throttle"];
+}
+
+template <int Order>
+void polyfit(const std::vector<double>& xvals,
+             const std::vector<double>& yvals,
+             Eigen::Matrix<double, Order + 1, 1>& coeffs) {
+  assert(xvals.size() == yvals.size());
+  assert(int(xvals.size()) > Order);
+
+  // Fit in t = x / scale, which keeps the normal equations well conditioned:
+  // the waypoints are tens of meters ahead, and x^6 would swamp 1.
+  double scale = 0;
+  for (size_t i = 0; i < xvals.size(); i++) {
+    scale = std::max(scale, fabs(xvals[i]));
+  }
+  scale = scale > 0 ? scale : 1;
+
+  // Sums of t^k y and of t^k up to twice the order, the entries of A' y and
+  // of A' A for the Vandermonde matrix A
+  Eigen::Matrix<double, Order + 1, 1> aty;
+  Eigen::Matrix<double, 2 * Order + 1, 1> moments;
+  aty.setZero();
+  moments.setZero();
+  for (size_t i = 0; i < xvals.size(); i++) {
+    double t = xvals[i] / scale;
+    double power = 1;
+    for (int k = 0; k <= 2 * Order; k++) {
+      moments[k] += power;
+      if (k <= Order) {
+        aty[k] += power * yvals[i];
+      }
+      power *= t;
+    }
+  }
+  Eigen::Matrix<double, Order + 1, Order + 1> ata;
+  for (int r = 0; r <= Order; r++) {
+    for (int c = 0; c <= Order; c++) {
+      ata(r, c) = moments[r + c];
+    }
+  }
+
+  coeffs = ata.ldlt().solve(aty);
+  double power = 1;
+  for (int k = 1; k <= Order; k++) {
+    power *= scale;
+    coeffs[k] /= power;
+  }
+}
+
+template void polyfit<3>(const std::vector<double>& xvals,
+                         const std::vector<double>& yvals,
+                         Eigen::Vector4d& coeffs);
+
+double splineWaypoints(const TrackSpline& spline, double preview, double& s,
+                       Telemetry& telemetry) {
+  s = spline.Locate(telemetry.x, telemetry.y, s);
+  double ahead = std::max(30.0, fabs(telemetry.speed) * preview);
+  spline.Window(s, 5, ahead, 8, telemetry.ptsx, telemetry.ptsy);
+  return spline.MaxCurvature(s, s + ahead);
+}
+
+void prepareControlInput(const Telemetry& telemetry, double prev_a,
+                         double latency, ControlInput& input) {
+  double px = telemetry.x;
+  double py = telemetry.y;
+  double psi = telemetry.psi;
+  double v = telemetry.speed;
+
+  //transform to car coordinates (frame)
+  input.ptsx.resize(telemetry.ptsx.size());
+  input.ptsy.resize(telemetry.ptsy.size());
+  for (int i = 0; i < int(telemetry.ptsx.size()); i++) {
+    double dtx = telemetry.ptsx[i] - px;
+    double dty = telemetry.ptsy[i] - py;
+
+    input.ptsx[i] = dtx * cos(psi) + dty * sin(psi);
+    input.ptsy[i] = dty * cos(psi) - dtx * sin(psi);
+  }
+
+  // Fit polynomial to x and y coordinates. input.coeffs keeps its size, so
+  // this does not allocate after the first event.
+  Eigen::Vector4d coeffs;
+  polyfit<3>(input.ptsx, input.ptsy, coeffs);
+  input.coeffs = coeffs;
+
+  // Estimate cross-track error
+  double cte = polyeval(input.coeffs, 0);
+  // Calculate orientation error
+  double epsi = -atan(input.coeffs[1]);
+
+  // Previous steering angle and throttle
+  double delta = telemetry.steering_angle;
+  double dt = latency;
+
+  // Predict (x = y = psi = 0)
+  double predicted_x = v * dt;
+  double predicted_y = 0;
+  double predicted_psi = - v * delta / Lf * dt;
+  double predicted_v = v + prev_a * dt;
+  double predicted_cte = cte + v * sin(epsi) * dt;
+  double predicted_epsi = epsi + predicted_psi;
+
+  input.state.resize(6);
+  input.state << predicted_x, predicted_y, predicted_psi, predicted_v, predicted_cte, predicted_epsi;
+}
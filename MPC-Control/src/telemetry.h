@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "json.hpp"
+#include "track_spline.h"
+
+// Fields of a simulator "telemetry" event, see DATA.md.
+struct Telemetry {
+  // Global waypoint positions
+  std::vector<double> ptsx;
+  std::vector<double> ptsy;
+  // Global vehicle position, orientation [rad] and speed [mph]
+  double x;
+  double y;
+  double psi;
+  double speed;
+  // Current steering angle [rad] and throttle [-1, 1]
+  double steering_angle;
+  double throttle;
+};
+
+// What the controller works on for one telemetry event.
+struct ControlInput {
+  // Waypoints in the vehicle frame
+  std::vector<double> ptsx;
+  std::vector<double> ptsy;
+  // Cubic fitted to the vehicle frame waypoints
+  Eigen::VectorXd coeffs;
+  // [x, y, psi, v, cte, epsi] predicted to the end of the actuation latency
+  Eigen::VectorXd state;
+};
+
+// Reads the data object of a telemetry event, j[1] in main.cpp.
+void parseTelemetry(const nlohmann::json& data, Telemetry& telemetry);
+
+// Evaluates coeffs[0] + coeffs[1] x + coeffs[2] x^2 + ... by Horner's rule.
+// With a fixed-size vector the loop has a compile-time trip count.
+template <class Derived>
+double polyeval(const Eigen::MatrixBase<Derived>& coeffs, double x) {
+  double result = coeffs[coeffs.size() - 1];
+  for (int i = int(coeffs.size()) - 2; i >= 0; i--) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+// Least squares fit of a polynomial of the given order to the points
+// (xvals[i], yvals[i]), of which there must be more than the order. Solves the
+// (order + 1) x (order + 1) normal equations on the stack, so it does not
+// allocate. Defined for order 3.
+template <int Order>
+void polyfit(const std::vector<double>& xvals,
+             const std::vector<double>& yvals,
+             Eigen::Matrix<double, Order + 1, 1>& coeffs);
+
+// Replaces the waypoints of a telemetry event by 8 points of the track spline
+// around the vehicle, from 5 m behind it to as far as it drives in `preview`
+// seconds at its current speed, but at least 30 m. s is the arc length of the
+// vehicle at the previous event, negative for none, and is updated; only the
+// spline around it is searched, unless the vehicle is not there. Returns the
+// largest |curvature| [1/m] over the points.
+double splineWaypoints(const TrackSpline& spline, double preview, double& s,
+                       Telemetry& telemetry);
+
+// Transforms the waypoints to the vehicle frame, fits a cubic to them and
+// predicts the vehicle state `latency` seconds ahead, assuming the current
+// steering angle and the previous throttle `prev_a` are held until then.
+void prepareControlInput(const Telemetry& telemetry, double prev_a,
+                         double latency, ControlInput& input);
+
+#endif /* TELEMETRY_H */
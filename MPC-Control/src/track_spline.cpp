@@ -0,0 +1,233 @@
+#include "track_spline.h"
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/LU"
+
+namespace {
+
+// Points the spline is evaluated at per waypoint interval while tabulating
+const int substeps = 32;
+
+// Closed cubic spline of one coordinate over the knots t, with the second
+// derivative m at every knot
+struct Spline {
+  std::vector<double> t;
+  std::vector<double> p;
+  std::vector<double> m;
+
+  // Value and first two derivatives at u into interval i
+  void Evaluate(int i, double u, double& value, double& first,
+                double& second) const {
+    int n = p.size();
+    int j = (i + 1) % n;
+    double h = t[i + 1] - t[i];
+    double a = p[i] / h - m[i] * h / 6;
+    double b = p[j] / h - m[j] * h / 6;
+    value = m[i] * pow(h - u, 3) / (6 * h) + m[j] * pow(u, 3) / (6 * h) +
+            a * (h - u) + b * u;
+    first = -m[i] * (h - u) * (h - u) / (2 * h) + m[j] * u * u / (2 * h) - a +
+            b;
+    second = m[i] * (h - u) / h + m[j] * u / h;
+  }
+};
+
+// Second derivatives that make the spline through p at the knots t twice
+// continuously differentiable all the way round
+void fit(Spline& spline) {
+  int n = spline.p.size();
+  Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n);
+  Eigen::VectorXd rhs(n);
+  for (int i = 0; i < n; i++) {
+    int prev = (i + n - 1) % n;
+    int next = (i + 1) % n;
+    double h_prev = spline.t[prev + 1] - spline.t[prev];
+    double h = spline.t[i + 1] - spline.t[i];
+    A(i, prev) += h_prev;
+    A(i, i) += 2 * (h_prev + h);
+    A(i, next) += h;
+    rhs[i] = 6 * ((spline.p[next] - spline.p[i]) / h -
+                  (spline.p[i] - spline.p[prev]) / h_prev);
+  }
+  Eigen::VectorXd m = A.partialPivLu().solve(rhs);
+  spline.m.assign(m.data(), m.data() + n);
+}
+
+// Difference of two angles, wrapped to [-pi, pi]
+double angleDifference(double a, double b) {
+  return atan2(sin(a - b), cos(a - b));
+}
+
+}  // namespace
+
+bool TrackSpline::Build(const std::vector<double>& x,
+                        const std::vector<double>& y, double spacing) {
+  int n = x.size();
+  if (n < 3 || y.size() != x.size() || spacing <= 0) {
+    return false;
+  }
+
+  // Knots at the chord length from the first waypoint, the closing chord
+  // included
+  Spline sx, sy;
+  sx.p = x;
+  sy.p = y;
+  sx.t.assign(1, 0.0);
+  for (int i = 0; i < n; i++) {
+    int j = (i + 1) % n;
+    sx.t.push_back(sx.t.back() + hypot(x[j] - x[i], y[j] - y[i]));
+  }
+  sy.t = sx.t;
+  fit(sx);
+  fit(sy);
+
+  // Dense points along the spline with their arc length, direction and
+  // curvature
+  std::vector<double> fine_s, fine_x, fine_y, fine_dx, fine_dy, fine_k;
+  double s = 0;
+  for (int i = 0; i < n; i++) {
+    double h = sx.t[i + 1] - sx.t[i];
+    for (int k = 0; k < substeps; k++) {
+      double px, dx, ddx, py, dy, ddy;
+      sx.Evaluate(i, h * k / substeps, px, dx, ddx);
+      sy.Evaluate(i, h * k / substeps, py, dy, ddy);
+      if (!fine_x.empty()) {
+        s += hypot(px - fine_x.back(), py - fine_y.back());
+      }
+      fine_s.push_back(s);
+      fine_x.push_back(px);
+      fine_y.push_back(py);
+      fine_dx.push_back(dx);
+      fine_dy.push_back(dy);
+      fine_k.push_back((dx * ddy - dy * ddx) / pow(dx * dx + dy * dy, 1.5));
+    }
+  }
+  length = s + hypot(fine_x[0] - fine_x.back(), fine_y[0] - fine_y.back());
+
+  // Resampled at even arc length, the spacing rounded so the table closes
+  int size = std::max(3, int(round(length / spacing)));
+  this->spacing = length / size;
+  this->x.resize(size);
+  this->y.resize(size);
+  heading.resize(size);
+  curvature.resize(size);
+  int fine = fine_s.size();
+  int j = 0;
+  for (int k = 0; k < size; k++) {
+    double target = k * this->spacing;
+    while (j + 1 < fine && fine_s[j + 1] <= target) {
+      j++;
+    }
+    int next = (j + 1) % fine;
+    double next_s = j + 1 < fine ? fine_s[j + 1] : length;
+    double t = (target - fine_s[j]) / std::max(next_s - fine_s[j], 1e-12);
+    this->x[k] = fine_x[j] + t * (fine_x[next] - fine_x[j]);
+    this->y[k] = fine_y[j] + t * (fine_y[next] - fine_y[j]);
+    heading[k] = atan2(fine_dy[j] + t * (fine_dy[next] - fine_dy[j]),
+                       fine_dx[j] + t * (fine_dx[next] - fine_dx[j]));
+    curvature[k] = fine_k[j] + t * (fine_k[next] - fine_k[j]);
+  }
+  return true;
+}
+
+void TrackSpline::lookup(double s, int& i, double& t) const {
+  s = fmod(s, length);
+  if (s < 0) {
+    s += length;
+  }
+  double position = s / spacing;
+  i = std::min(int(position), int(x.size()) - 1);
+  t = position - i;
+}
+
+void TrackSpline::Position(double s, double& px, double& py) const {
+  int i;
+  double t;
+  lookup(s, i, t);
+  int j = (i + 1) % x.size();
+  px = x[i] + t * (x[j] - x[i]);
+  py = y[i] + t * (y[j] - y[i]);
+}
+
+double TrackSpline::Heading(double s) const {
+  int i;
+  double t;
+  lookup(s, i, t);
+  int j = (i + 1) % x.size();
+  return heading[i] + t * angleDifference(heading[j], heading[i]);
+}
+
+double TrackSpline::Curvature(double s) const {
+  int i;
+  double t;
+  lookup(s, i, t);
+  int j = (i + 1) % x.size();
+  return curvature[i] + t * (curvature[j] - curvature[i]);
+}
+
+double TrackSpline::MaxCurvature(double from, double to) const {
+  double largest = 0;
+  for (double s = from; s < to; s += spacing) {
+    largest = std::max(largest, fabs(Curvature(s)));
+  }
+  return std::max(largest, fabs(Curvature(to)));
+}
+
+double TrackSpline::Locate(double px, double py, double s_hint,
+                           double window) const {
+  int size = x.size();
+  int first = 0;
+  int count = size;
+  if (s_hint >= 0) {
+    int i;
+    double t;
+    lookup(s_hint - window, i, t);
+    first = i;
+    count = std::min(size, int(2 * window / spacing) + 2);
+  }
+
+  // Closest table entry, then the closest point of the two table segments
+  // next to it
+  int best = first;
+  double best_distance = INFINITY;
+  for (int k = 0; k < count; k++) {
+    int i = (first + k) % size;
+    double distance = hypot(px - x[i], py - y[i]);
+    if (distance < best_distance) {
+      best_distance = distance;
+      best = i;
+    }
+  }
+  // Farther off than the window means the hint was stale, say after a reset
+  // of the simulator, so it cannot be trusted
+  if (s_hint >= 0 && best_distance > window) {
+    return Locate(px, py);
+  }
+  double s = best * spacing;
+  best_distance = INFINITY;
+  for (int k = -1; k <= 0; k++) {
+    int i = (best + k + size) % size;
+    int j = (i + 1) % size;
+    double dx = x[j] - x[i];
+    double dy = y[j] - y[i];
+    double t = ((px - x[i]) * dx + (py - y[i]) * dy) / (dx * dx + dy * dy);
+    t = std::max(0.0, std::min(1.0, t));
+    double distance = hypot(px - x[i] - t * dx, py - y[i] - t * dy);
+    if (distance < best_distance) {
+      best_distance = distance;
+      s = (i + t) * spacing;
+    }
+  }
+  return fmod(s, length);
+}
+
+void TrackSpline::Window(double s, double behind, double ahead, int count,
+                         std::vector<double>& ptsx,
+                         std::vector<double>& ptsy) const {
+  ptsx.resize(count);
+  ptsy.resize(count);
+  for (int k = 0; k < count; k++) {
+    double at = s - behind + (behind + ahead) * k / std::max(count - 1, 1);
+    Position(at, ptsx[k], ptsy[k]);
+  }
+}
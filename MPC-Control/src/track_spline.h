@@ -0,0 +1,58 @@
+#ifndef TRACK_SPLINE_H
+#define TRACK_SPLINE_H
+
+#include <vector>
+
+//
+// Closed cubic spline through the waypoints of a track, such as those
+// Track::Load reads from lake_track_waypoints.csv, tabulated once at even
+// steps of arc length. Every query after that only looks at the table entries
+// around an arc length, so the reference of a control cycle costs O(window)
+// lookups however long the track is.
+//
+class TrackSpline {
+ public:
+  // Fits the spline through the waypoints, driven in their order and closed
+  // back to the first, and tabulates it every `spacing` meters. False with
+  // fewer than 3 waypoints.
+  bool Build(const std::vector<double>& x, const std::vector<double>& y,
+             double spacing = 0.5);
+
+  bool Empty() const { return x.empty(); }
+  double Length() const { return length; }
+
+  // Position, heading [rad] and signed curvature (positive turning left)
+  // [1/m] at arc length s, taken modulo the length
+  void Position(double s, double& px, double& py) const;
+  double Heading(double s) const;
+  double Curvature(double s) const;
+
+  // Largest |curvature| between arc lengths from and to
+  double MaxCurvature(double from, double to) const;
+
+  // Arc length of the point of the track closest to (px, py). With
+  // s_hint >= 0 only the `window` meters around s_hint are searched, which is
+  // all a vehicle moves between two control cycles; otherwise, or if nothing
+  // there is within `window` meters of (px, py), the whole track.
+  double Locate(double px, double py, double s_hint = -1,
+                double window = 20) const;
+
+  // `count` points evenly spaced from `behind` meters before arc length s to
+  // `ahead` meters after it, in global coordinates
+  void Window(double s, double behind, double ahead, int count,
+              std::vector<double>& ptsx, std::vector<double>& ptsy) const;
+
+ private:
+  // Table index at or below arc length s, and the fraction to the next one
+  void lookup(double s, int& i, double& t) const;
+
+  double spacing;
+  double length;
+  // Tabulated every spacing meters from the first waypoint
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> heading;
+  std::vector<double> curvature;
+};
+
+#endif /* TRACK_SPLINE_H */
@@ -0,0 +1,643 @@
+/*
+ * benchmark.cpp
+ *
+ * Micro-benchmarks for the particle filter building blocks. Runs without the
+ * simulator; pass a section name to run only that section.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+#include "filter_engine.h"
+#include "likelihood_field.h"
+#include "map_loader.h"
+#include "observation_transform.h"
+#include "particle_filter.h"
+#include "telemetry_parser.h"
+
+using namespace std;
+
+// for convenience
+using json = nlohmann::json;
+
+// Keeps results alive so the optimizer cannot drop the benchmarked work
+static volatile double benchmark_sink;
+
+// Calls into the global operator new made by any thread, nothrow forms
+// included, counted by the replacements below
+static atomic<size_t> heap_allocations(0);
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+	heap_allocations.fetch_add(1, memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t& tag) noexcept {
+	return operator new(size, tag);
+}
+
+void* operator new(size_t size) {
+	void* p = operator new(size, nothrow);
+	if (!p) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+// GCC inlines these into callers and then reports free() on memory from
+// operator new, which the replacements above make malloc'ed memory
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const nothrow_t&) noexcept {
+	std::free(p);
+}
+
+#pragma GCC diagnostic pop
+
+// Runs fn repeatedly for at least min_seconds and returns the mean time per call [us]
+template <typename F>
+static double timeCall(F fn, double min_seconds = 0.2) {
+	fn();
+	long calls = 0;
+	auto start = chrono::steady_clock::now();
+	double elapsed = 0;
+	do {
+		fn();
+		calls++;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	} while (elapsed < min_seconds);
+	return elapsed * 1e6 / calls;
+}
+
+// Uniformly scattered landmarks on a square of side extent [m]
+static void randomMap(int num_landmarks, double extent, unsigned seed, Map& map) {
+	default_random_engine gen(seed);
+	uniform_real_distribution<float> coord(0, extent);
+	map.landmark_list.resize(num_landmarks);
+	for (int i = 0; i < num_landmarks; i++) {
+		map.landmark_list[i].id_i = i + 1;
+		map.landmark_list[i].x_f = coord(gen);
+		map.landmark_list[i].y_f = coord(gen);
+	}
+}
+
+// Noisy map-frame observations of up to n landmarks in range of (x, y)
+static vector<LandmarkObs> observeLandmarks(const Map& map, double x, double y, double range, int n,
+		unsigned seed) {
+	default_random_engine gen(seed);
+	normal_distribution<double> noise(0, 0.3);
+	vector<LandmarkObs> observations;
+	for (size_t k = 0; k < map.landmark_list.size() && (int)observations.size() < n; k++) {
+		const Map::single_landmark_s& l = map.landmark_list[k];
+		if (dist(x, y, l.x_f, l.y_f) <= range) {
+			observations.push_back(LandmarkObs{ -1, l.x_f + noise(gen), l.y_f + noise(gen) });
+		}
+	}
+	return observations;
+}
+
+// Association of one particle's observations: the original id-based nearest
+// neighbour with its second lookup pass against the spatial index and the
+// globally optimal assignment, at growing observation counts.
+static void benchmarkAssociation() {
+	const double extent = 1000;
+	const double sensor_range = 50;
+	const double center = extent / 2;
+
+	Map map;
+	randomMap(150000, extent, 1, map);
+	map.buildIndex();
+	ParticleFilter pf;
+
+	printf("association: %zu landmarks, sensor range %.0f m\n", map.landmark_list.size(), sensor_range);
+	printf("%8s %14s %14s %14s\n", "obs", "linear [us]", "index [us]", "global [us]");
+
+	int counts[] = { 10, 50, 200, 500, 1000 };
+	for (int n : counts) {
+		vector<LandmarkObs> observations = observeLandmarks(map, center, center, sensor_range, n, 2);
+		vector<int> matches(observations.size());
+		vector<double> obs_x(observations.size()), obs_y(observations.size());
+		for (size_t j = 0; j < observations.size(); j++) {
+			obs_x[j] = observations[j].x;
+			obs_y[j] = observations[j].y;
+		}
+
+		// Original path: gather predictions in range, associate by id, look the id up again
+		double linear = timeCall([&]() {
+			vector<LandmarkObs> predictions;
+			for (size_t k = 0; k < map.landmark_list.size(); k++) {
+				const Map::single_landmark_s& l = map.landmark_list[k];
+				if (dist(center, center, l.x_f, l.y_f) <= sensor_range) {
+					predictions.push_back(LandmarkObs{ l.id_i, l.x_f, l.y_f });
+				}
+			}
+			vector<LandmarkObs> associated(observations);
+			pf.dataAssociation(predictions, associated);
+			double sum = 0;
+			for (size_t j = 0; j < associated.size(); j++) {
+				for (size_t k = 0; k < predictions.size(); k++) {
+					if (predictions[k].id == associated[j].id) {
+						sum += predictions[k].x;
+					}
+				}
+			}
+			benchmark_sink = sum;
+		});
+
+		double indexed = timeCall([&]() {
+			associateObservations(ASSOCIATION_NEAREST, map, center, center, sensor_range, 2.0,
+					obs_x.data(), obs_y.data(), obs_x.size(), matches.data());
+			benchmark_sink = matches[0];
+		});
+
+		double global = timeCall([&]() {
+			associateObservations(ASSOCIATION_GLOBAL, map, center, center, sensor_range, 2.0,
+					obs_x.data(), obs_y.data(), obs_x.size(), matches.data());
+			benchmark_sink = matches[0];
+		});
+
+		printf("%8zu %14.1f %14.1f %14.1f\n", observations.size(), linear, indexed, global);
+	}
+}
+
+// Transform of the observations into every particle's map frame: the original
+// per-observation loop with four trig calls into LandmarkObs structs versus the
+// batched structure-of-arrays kernel with the trig hoisted per particle.
+static void benchmarkTransform() {
+	printf("transform: observations to map frame for all particles\n");
+	printf("%10s %6s %14s %14s %10s\n", "particles", "obs", "per-obs [us]", "batched [us]", "speedup");
+
+	default_random_engine gen(4);
+	uniform_real_distribution<double> coord(-50, 50);
+	uniform_real_distribution<double> heading(-M_PI, M_PI);
+
+	int particle_counts[] = { 100, 500, 2000 };
+	int observation_counts[] = { 10, 40, 200 };
+	for (int n_particles : particle_counts) {
+		for (int n_observations : observation_counts) {
+			vector<Particle> particles(n_particles);
+			for (Particle& p : particles) {
+				p.x = coord(gen);
+				p.y = coord(gen);
+				p.theta = heading(gen);
+			}
+			vector<LandmarkObs> observations(n_observations);
+			for (LandmarkObs& o : observations) {
+				o.x = coord(gen);
+				o.y = coord(gen);
+			}
+
+			vector<LandmarkObs> transformed(n_observations);
+			double per_observation = timeCall([&]() {
+				double sum = 0;
+				for (const Particle& p : particles) {
+					for (int j = 0; j < n_observations; j++) {
+						double t_x = cos(p.theta)*observations[j].x - sin(p.theta)*observations[j].y + p.x;
+						double t_y = sin(p.theta)*observations[j].x + cos(p.theta)*observations[j].y + p.y;
+						transformed[j] = LandmarkObs{ observations[j].id, t_x, t_y };
+					}
+					sum += transformed[n_observations - 1].x;
+				}
+				benchmark_sink = sum;
+			});
+
+			vector<double> obs_x(n_observations), obs_y(n_observations);
+			vector<double> p_x(n_particles), p_y(n_particles), cos_theta(n_particles), sin_theta(n_particles);
+			vector<double> map_x(n_particles * n_observations), map_y(n_particles * n_observations);
+			double batched = timeCall([&]() {
+				for (int j = 0; j < n_observations; j++) {
+					obs_x[j] = observations[j].x;
+					obs_y[j] = observations[j].y;
+				}
+				for (int i = 0; i < n_particles; i++) {
+					p_x[i] = particles[i].x;
+					p_y[i] = particles[i].y;
+					cos_theta[i] = cos(particles[i].theta);
+					sin_theta[i] = sin(particles[i].theta);
+				}
+				transformObservations(p_x.data(), p_y.data(), cos_theta.data(), sin_theta.data(), n_particles,
+						obs_x.data(), obs_y.data(), n_observations, map_x.data(), map_y.data());
+				benchmark_sink = map_x.back();
+			});
+
+			printf("%10d %6d %14.1f %14.1f %9.1fx\n", n_particles, n_observations,
+					per_observation, batched, per_observation / batched);
+		}
+	}
+}
+
+// Gaussian noise for prediction: std::normal_distribution on the default
+// engine, one draw at a time, versus bulk draws from the filter's Philox stream.
+static void benchmarkRandom() {
+	printf("random: standard normal draws\n");
+	printf("%10s %16s %16s %10s\n", "draws", "std [ns/draw]", "bulk [ns/draw]", "speedup");
+
+	size_t counts[] = { 150, 1500, 15000 };
+	for (size_t n : counts) {
+		vector<double> noise(n);
+
+		default_random_engine gen(1);
+		normal_distribution<double> normal(0, 1);
+		double standard = timeCall([&]() {
+			for (size_t i = 0; i < n; i++) {
+				noise[i] = normal(gen);
+			}
+			benchmark_sink = noise[n - 1];
+		});
+
+		FilterRandom random(1);
+		double bulk = timeCall([&]() {
+			random.gaussian(noise.data(), n);
+			benchmark_sink = noise[n - 1];
+		});
+
+		printf("%10zu %16.2f %16.2f %9.1fx\n", n, standard * 1e3 / n, bulk * 1e3 / n, standard / bulk);
+	}
+}
+
+// Particle weighting by exact nearest-landmark association versus likelihood
+// field lookups at several resolutions: build time and memory of the field,
+// updateWeights time, and the error of the field's log-likelihood per
+// observation against the exact weights and how far its best particle lies
+// from the exact best particle.
+static void benchmarkLikelihoodField() {
+	const double extent = 200;
+	const double sensor_range = 50;
+	const double max_distance = 5;
+	const double center = extent / 2;
+	const double heading = 0.3;
+	double sigma_pos[3] = { 0.3, 0.3, 0.01 };
+	double sigma_landmark[2] = { 0.3, 0.3 };
+
+	Map map;
+	randomMap(20000, extent, 5, map);
+	map.buildIndex();
+
+	// Vehicle-frame observations of the landmarks in range of the true pose
+	vector<LandmarkObs> observations = observeLandmarks(map, center, center, sensor_range, 40, 6);
+	for (LandmarkObs& o : observations) {
+		double dx = o.x - center;
+		double dy = o.y - center;
+		o.x = cos(heading) * dx + sin(heading) * dy;
+		o.y = -sin(heading) * dx + cos(heading) * dy;
+	}
+
+	ParticleFilter pf(7);
+	pf.setParticleBounds(500, 500);
+	pf.setAssociation(ASSOCIATION_NEAREST, max_distance);
+	pf.init(center, center, heading, sigma_pos);
+
+	double exact_us = timeCall([&]() {
+		pf.updateWeights(sensor_range, sigma_landmark, observations, map);
+	});
+	vector<double> exact_log_weights(pf.particles.size());
+	for (size_t i = 0; i < pf.particles.size(); i++) {
+		exact_log_weights[i] = log(pf.particles[i].weight);
+	}
+	const Particle exact_best = pf.bestParticle();
+
+	printf("likelihood field: %zu landmarks on %.0f m, %zu particles, %zu observations\n",
+			map.landmark_list.size(), extent, pf.particles.size(), observations.size());
+	printf("%12s %10s %10s %12s %14s %14s\n", "weighting", "build [ms]", "mem [MB]", "update [us]",
+			"|dlogL|/obs", "best off [m]");
+	printf("%12s %10s %10s %12.1f %14s %14s\n", "exact", "-", "-", exact_us, "-", "-");
+
+	double resolutions[] = { 0.4, 0.2, 0.1, 0.05 };
+	for (double resolution : resolutions) {
+		LikelihoodField field;
+		auto start = chrono::steady_clock::now();
+		if (!field.build(map, resolution, sigma_landmark, max_distance)) {
+			printf("%10.2f m  too large\n", resolution);
+			continue;
+		}
+		double build_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		pf.setLikelihoodField(&field);
+		double field_us = timeCall([&]() {
+			pf.updateWeights(sensor_range, sigma_landmark, observations, map);
+		});
+		double error = 0;
+		for (size_t i = 0; i < pf.particles.size(); i++) {
+			error += fabs(log(pf.particles[i].weight) - exact_log_weights[i]);
+		}
+		error /= pf.particles.size() * observations.size();
+		double best_offset = dist(pf.bestParticle().x, pf.bestParticle().y, exact_best.x, exact_best.y);
+		pf.setLikelihoodField(nullptr);
+
+		char name[32];
+		snprintf(name, sizeof(name), "field %.2f m", resolution);
+		printf("%12s %10.1f %10.1f %12.1f %14.3f %14.3f\n", name, build_ms, field.memoryBytes() / 1048576.0,
+				field_us, error, best_offset);
+	}
+}
+
+// Fleet throughput of the multi-session engine: many vehicles circling on one
+// shared map, every vehicle stepped once per round, at several fleet sizes
+// and worker counts.
+static void benchmarkSessions() {
+	const double extent = 1000;
+	const int num_steps = 50;
+	FilterSettings settings;
+
+	Map map;
+	randomMap(4000, extent, 8, map);
+	map.buildIndex();
+
+	int hardware_threads = max(1u, thread::hardware_concurrency());
+	int fleet_sizes[] = { 1, 16, 128, 512 };
+	int max_fleet = fleet_sizes[3];
+
+	// Telemetry of every vehicle and step: constant speed and yaw rate circles
+	default_random_engine gen(9);
+	uniform_real_distribution<double> start(100, extent - 100);
+	uniform_real_distribution<double> heading(-M_PI, M_PI);
+	normal_distribution<double> noise(0, 0.3);
+	const double velocity = 5, yaw_rate = 0.1;
+	vector<vector<Telemetry> > fleet(max_fleet, vector<Telemetry>(num_steps));
+	for (int v = 0; v < max_fleet; v++) {
+		double x = start(gen), y = start(gen), theta = heading(gen);
+		for (int t = 0; t < num_steps; t++) {
+			Telemetry& telemetry = fleet[v][t];
+			telemetry.session_id = v + 1;
+			telemetry.has_sense = true;
+			telemetry.sense_x = x + noise(gen);
+			telemetry.sense_y = y + noise(gen);
+			telemetry.sense_theta = theta;
+			telemetry.has_control = true;
+			telemetry.previous_velocity = velocity;
+			telemetry.previous_yawrate = yaw_rate;
+			double c = cos(theta), s = sin(theta);
+			map.index.forEachInRadius(x, y, settings.sensor_range, [&](int, double lx, double ly) {
+				double dx = lx - x, dy = ly - y;
+				telemetry.observations.push_back(LandmarkObs{ -1, c * dx + s * dy + noise(gen),
+						-s * dx + c * dy + noise(gen) });
+			});
+			x += velocity / yaw_rate * (sin(theta + yaw_rate * settings.delta_t) - sin(theta));
+			y += velocity / yaw_rate * (cos(theta) - cos(theta + yaw_rate * settings.delta_t));
+			theta += yaw_rate * settings.delta_t;
+		}
+	}
+
+	printf("sessions: %zu landmarks, %d steps per vehicle\n", map.landmark_list.size(), num_steps);
+	printf("%8s %8s %20s\n", "threads", "vehicles", "vehicle-steps/s");
+	int thread_counts[] = { 1, hardware_threads };
+	for (int threads : thread_counts) {
+		for (int vehicles : fleet_sizes) {
+			FilterEngine engine(map, settings, threads);
+			Telemetry work;
+			auto begin = chrono::steady_clock::now();
+			for (int t = 0; t < num_steps; t++) {
+				for (int v = 0; v < vehicles; v++) {
+					work = fleet[v][t];
+					engine.submit(work);
+				}
+				engine.wait();
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+			printf("%8d %8d %20.0f\n", threads, vehicles, vehicles * num_steps / seconds);
+		}
+		if (hardware_threads == 1) {
+			break;
+		}
+	}
+}
+
+// Heap use of updateWeights once the filter has settled: a fixed particle
+// count stepping in place over one observation set, so every step does the
+// same work. After the warm-up steps neither updateWeights nor resample is
+// expected to reach the heap at all, through operator new or through the
+// scratch arena. Returns false if either did.
+static bool benchmarkSteadyState() {
+	const double extent = 1000;
+	const double sensor_range = 50;
+	const double center = extent / 2;
+	const int num_particles = 1000;
+	const int warmup_steps = 20;
+	const int num_steps = 200;
+	double sigma_pos[3] = { 0.3, 0.3, 0.01 };
+	const double sigma_landmark[2] = { 0.3, 0.3 };
+
+	Map map;
+	randomMap(20000, extent, 10, map);
+	map.buildIndex();
+
+	// Vehicle at the center heading along x, so map offsets are vehicle coordinates
+	vector<LandmarkObs> observations = observeLandmarks(map, center, center, sensor_range, 100, 11);
+	for (size_t j = 0; j < observations.size(); j++) {
+		observations[j].x -= center;
+		observations[j].y -= center;
+	}
+
+	printf("steady state: %d particles, %zu observations, heap allocations per step after %d warm-up steps\n",
+			num_particles, observations.size(), warmup_steps);
+	printf("%10s %10s %10s %10s %10s %10s\n", "method", "warm-up", "heap", "max", "scratch", "resample");
+
+	bool passed = true;
+	AssociationMethod methods[] = { ASSOCIATION_NEAREST, ASSOCIATION_GLOBAL };
+	const char* names[] = { "nearest", "global" };
+	for (int m = 0; m < 2; m++) {
+		ParticleFilter pf;
+		pf.setParticleBounds(num_particles, num_particles);
+		pf.setAssociation(methods[m], 2.0);
+		pf.init(center, center, 0, sigma_pos);
+
+		size_t warmup = 0, total = 0, most = 0, scratch = 0, resampled = 0;
+		for (int t = 0; t < warmup_steps + num_steps; t++) {
+			pf.prediction(0.1, sigma_pos, 0, 0);
+			size_t before = heap_allocations.load(memory_order_relaxed);
+			pf.updateWeights(sensor_range, sigma_landmark, observations, map);
+			size_t heap = heap_allocations.load(memory_order_relaxed) - before;
+			if (t < warmup_steps) {
+				warmup += heap + pf.stepStats().scratch_allocations;
+			} else {
+				total += heap;
+				most = max(most, heap);
+				scratch += pf.stepStats().scratch_allocations;
+			}
+			before = heap_allocations.load(memory_order_relaxed);
+			pf.resample();
+			heap = heap_allocations.load(memory_order_relaxed) - before;
+			if (t < warmup_steps) {
+				warmup += heap;
+			} else {
+				resampled += heap;
+			}
+		}
+		bool allocated = total > 0 || scratch > 0 || resampled > 0;
+		printf("%10s %10zu %10.2f %10zu %10zu %10zu%s\n", names[m], warmup, (double)total / num_steps, most, scratch,
+				resampled, allocated ? "  FAILED" : "");
+		passed = passed && !allocated;
+	}
+	return passed;
+}
+
+// Loading a large map: line-by-line text parsing versus the memory-mapped
+// loader on a cold cache (parse and write the cache) and a warm cache
+static void benchmarkMapLoading() {
+	const char* filename = "/tmp/pf_benchmark_map.txt";
+	const int num_landmarks = 1000000;
+
+	Map generated;
+	randomMap(num_landmarks, 20000, 3, generated);
+	FILE* out = fopen(filename, "w");
+	if (!out) {
+		printf("map loading: cannot write %s\n", filename);
+		return;
+	}
+	for (size_t i = 0; i < generated.landmark_list.size(); i++) {
+		const Map::single_landmark_s& l = generated.landmark_list[i];
+		fprintf(out, "%.3f\t%.3f\t%d\n", l.x_f, l.y_f, l.id_i);
+	}
+	fclose(out);
+	string cache_name = string(filename) + ".cache";
+	remove(cache_name.c_str());
+
+	auto elapsed_ms = [](chrono::steady_clock::time_point start) {
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	};
+
+	auto start = chrono::steady_clock::now();
+	Map text_map;
+	read_map_data(filename, text_map);
+	text_map.buildIndex();
+	double text_ms = elapsed_ms(start);
+
+	start = chrono::steady_clock::now();
+	Map cold_map;
+	read_map_data_cached(filename, cold_map);
+	double cold_ms = elapsed_ms(start);
+
+	start = chrono::steady_clock::now();
+	Map warm_map;
+	read_map_data_cached(filename, warm_map);
+	double warm_ms = elapsed_ms(start);
+
+	printf("map loading: %d landmarks\n", num_landmarks);
+	printf("  read_map_data + buildIndex  %10.1f ms\n", text_ms);
+	printf("  cached loader, cold cache   %10.1f ms\n", cold_ms);
+	printf("  cached loader, warm cache   %10.1f ms\n", warm_ms);
+
+	remove(filename);
+	remove(cache_name.c_str());
+}
+
+// Decoding of one telemetry message, the original nlohmann::json path against
+// the single-pass decoder, in messages per second
+static void benchmarkTelemetry() {
+	const int num_observations = 40;
+
+	string sense_x, sense_y;
+	default_random_engine gen(4);
+	uniform_real_distribution<double> coord(-50, 50);
+	for (int i = 0; i < num_observations; i++) {
+		char value[32];
+		snprintf(value, sizeof(value), "%s%.4f", i ? " " : "", coord(gen));
+		sense_x += value;
+		snprintf(value, sizeof(value), "%s%.4f", i ? " " : "", coord(gen));
+		sense_y += value;
+	}
+	string message = "42[\"telemetry\",{\"previous_velocity\":\"4.0992\",\"previous_yawrate\":\"0.0203\","
+			"\"sense_observations_x\":\"" + sense_x + "\",\"sense_observations_y\":\"" + sense_y + "\","
+			"\"sense_theta\":\"0.1934\",\"sense_x\":\"6.2785\",\"sense_y\":\"1.9598\"}]";
+
+	// Original path: copy, find the brackets, parse a json document, stod and istringstream
+	auto legacy = [&message]() {
+		string s = string(message.data());
+		auto b1 = s.find_first_of("[");
+		auto b2 = s.find_first_of("]");
+		if (s.find("null") != string::npos || b1 == string::npos || b2 == string::npos) {
+			return;
+		}
+		auto j = json::parse(s.substr(b1, b2 - b1 + 1));
+		if (j[0].get<string>() != "telemetry") {
+			return;
+		}
+		double x = stod(j[1]["sense_x"].get<string>());
+		x += stod(j[1]["previous_velocity"].get<string>());
+		x += stod(j[1]["previous_yawrate"].get<string>());
+		string obs_x = j[1]["sense_observations_x"];
+		string obs_y = j[1]["sense_observations_y"];
+		vector<float> x_sense, y_sense;
+		istringstream iss_x(obs_x), iss_y(obs_y);
+		copy(istream_iterator<float>(iss_x), istream_iterator<float>(), back_inserter(x_sense));
+		copy(istream_iterator<float>(iss_y), istream_iterator<float>(), back_inserter(y_sense));
+		vector<LandmarkObs> observations;
+		for (size_t i = 0; i < x_sense.size(); i++) {
+			observations.push_back(LandmarkObs{ 0, x_sense[i], y_sense[i] });
+		}
+		benchmark_sink = x + observations.back().y;
+	};
+
+	Telemetry telemetry;
+	auto decoder = [&message, &telemetry]() {
+		parse_telemetry(message.data(), message.size(), telemetry);
+		benchmark_sink = telemetry.sense_x + telemetry.previous_velocity + telemetry.observations.back().y;
+	};
+
+	double legacy_us = timeCall(legacy);
+	double decoder_us = timeCall(decoder);
+	printf("telemetry: %d observations, %zu byte message\n", num_observations, message.size());
+	printf("  json + istringstream  %12.0f msg/s\n", 1e6 / legacy_us);
+	printf("  parse_telemetry       %12.0f msg/s\n", 1e6 / decoder_us);
+}
+
+int main(int argc, char* argv[]) {
+	string section = argc > 1 ? argv[1] : "";
+
+	if (section.empty() || section == "association") {
+		benchmarkAssociation();
+	}
+	if (section.empty() || section == "transform") {
+		benchmarkTransform();
+	}
+	if (section.empty() || section == "random") {
+		benchmarkRandom();
+	}
+	if (section.empty() || section == "likelihoodfield") {
+		benchmarkLikelihoodField();
+	}
+	if (section.empty() || section == "sessions") {
+		benchmarkSessions();
+	}
+	if (section.empty() || section == "telemetry") {
+		benchmarkTelemetry();
+	}
+	if (section.empty() || section == "maploading") {
+		benchmarkMapLoading();
+	}
+	bool passed = true;
+	if (section.empty() || section == "steadystate") {
+		passed = benchmarkSteadyState();
+	}
+	return passed ? 0 : 1;
+}
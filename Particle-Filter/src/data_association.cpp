@@ -0,0 +1,161 @@
+/*
+ * data_association.cpp
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "data_association.h"
+#include "scratch_arena.h"
+
+using namespace std;
+
+static const double kInfinity = numeric_limits<double>::infinity();
+
+// Nearest landmark per observation by scanning the landmark list, for maps
+// without a spatial index
+static void nearestByScan(const Map& map, double p_x, double p_y, double sensor_range, double gate,
+		const double* obs_x, const double* obs_y, size_t n_observations, int* matches) {
+	const vector<Map::single_landmark_s>& landmarks = map.landmark_list;
+	double range2 = sensor_range * sensor_range;
+	double gate2 = gate * gate;
+
+	for (size_t i = 0; i < n_observations; i++) {
+		double best_d2 = gate2;
+		matches[i] = -1;
+		for (size_t k = 0; k < landmarks.size(); k++) {
+			double rx = landmarks[k].x_f - p_x;
+			double ry = landmarks[k].y_f - p_y;
+			double dx = landmarks[k].x_f - obs_x[i];
+			double dy = landmarks[k].y_f - obs_y[i];
+			double d2 = dx * dx + dy * dy;
+			if (d2 < best_d2 && rx * rx + ry * ry <= range2) {
+				best_d2 = d2;
+				matches[i] = (int)k;
+			}
+		}
+	}
+}
+
+// Minimum-cost assignment of observations to candidate landmarks. Each observation
+// additionally owns a dummy column costing gate^2, so observations without a
+// candidate inside the gate end up unassociated instead of forcing a bad match.
+// Hungarian method with potentials, O(n^2 (m + n)).
+static void assignGlobal(const Map& map, const ScratchVector<int>& candidates, double gate,
+		const double* obs_x, const double* obs_y, size_t n_observations, int* matches) {
+	ScratchArena& arena = ScratchArena::local();
+	ArenaAllocator<double> scratch_d(arena);
+	ArenaAllocator<int> scratch_i(arena);
+
+	int n = (int)n_observations;
+	int m = (int)candidates.size();
+	int cols = m + n;
+	double gate2 = gate * gate;
+
+	// Cost of assigning observation row (1-based) to column col (1-based)
+	auto cost = [&](int row, int col) -> double {
+		if (col > m) {
+			return (col - m == row) ? gate2 : kInfinity;
+		}
+		const Map::single_landmark_s& l = map.landmark_list[candidates[col - 1]];
+		double dx = l.x_f - obs_x[row - 1];
+		double dy = l.y_f - obs_y[row - 1];
+		double d2 = dx * dx + dy * dy;
+		return d2 < gate2 ? d2 : kInfinity;
+	};
+
+	ScratchVector<double> u(n + 1, 0.0, scratch_d);
+	ScratchVector<double> v(cols + 1, 0.0, scratch_d);
+	ScratchVector<double> minv(cols + 1, 0.0, scratch_d);
+	ScratchVector<int> p(cols + 1, 0, scratch_i);
+	ScratchVector<int> way(cols + 1, 0, scratch_i);
+	ScratchVector<int> used(cols + 1, 0, scratch_i);
+
+	for (int i = 1; i <= n; i++) {
+		p[0] = i;
+		int j0 = 0;
+		fill(minv.begin(), minv.end(), kInfinity);
+		fill(used.begin(), used.end(), 0);
+		do {
+			used[j0] = 1;
+			int i0 = p[j0];
+			int j1 = 0;
+			double delta = kInfinity;
+			for (int j = 1; j <= cols; j++) {
+				if (!used[j]) {
+					double cur = cost(i0, j) - u[i0] - v[j];
+					if (cur < minv[j]) {
+						minv[j] = cur;
+						way[j] = j0;
+					}
+					if (minv[j] < delta) {
+						delta = minv[j];
+						j1 = j;
+					}
+				}
+			}
+			for (int j = 0; j <= cols; j++) {
+				if (used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while (p[j0] != 0);
+		do {
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0);
+	}
+
+	for (int i = 0; i < n; i++) {
+		matches[i] = -1;
+	}
+	for (int j = 1; j <= m; j++) {
+		if (p[j] != 0) {
+			matches[p[j] - 1] = candidates[j - 1];
+		}
+	}
+}
+
+void associateObservations(AssociationMethod method, const Map& map, double p_x, double p_y,
+		double sensor_range, double gate, const double* obs_x, const double* obs_y, size_t n_observations,
+		int* matches) {
+
+	if (method == ASSOCIATION_NEAREST) {
+		if (map.index.empty()) {
+			nearestByScan(map, p_x, p_y, sensor_range, gate, obs_x, obs_y, n_observations, matches);
+			return;
+		}
+		for (size_t i = 0; i < n_observations; i++) {
+			matches[i] = map.index.nearest(obs_x[i], obs_y[i], gate, p_x, p_y, sensor_range);
+		}
+		return;
+	}
+
+	ScratchArena& arena = ScratchArena::local();
+	ScratchArena::Scope scope(arena);
+	ArenaAllocator<int> scratch(arena);
+
+	// Candidate landmarks within sensor range of the particle
+	ScratchVector<int> candidates(scratch);
+	if (map.index.empty()) {
+		double range2 = sensor_range * sensor_range;
+		for (size_t k = 0; k < map.landmark_list.size(); k++) {
+			double rx = map.landmark_list[k].x_f - p_x;
+			double ry = map.landmark_list[k].y_f - p_y;
+			if (rx * rx + ry * ry <= range2) {
+				candidates.push_back((int)k);
+			}
+		}
+	} else {
+		map.index.forEachInRadius(p_x, p_y, sensor_range, [&candidates](int k, double, double) {
+			candidates.push_back(k);
+		});
+	}
+
+	assignGlobal(map, candidates, min(gate, 4.0 * sensor_range), obs_x, obs_y, n_observations, matches);
+}
@@ -0,0 +1,37 @@
+/*
+ * data_association.h
+ *
+ * Gated association of observations with map landmarks.
+ */
+
+#ifndef DATA_ASSOCIATION_H_
+#define DATA_ASSOCIATION_H_
+
+#include "helper_functions.h"
+
+enum AssociationMethod {
+	ASSOCIATION_NEAREST,	// Nearest landmark per observation, looked up in the spatial index
+	ASSOCIATION_GLOBAL		// Globally optimal one-to-one assignment (Hungarian method)
+};
+
+/**
+ * associateObservations Associates the map-frame observations of one particle with
+ *   landmarks within sensor range of the particle. Scratch memory is taken from the
+ *   calling thread's ScratchArena.
+ * @param method Association method
+ * @param map Map landmarks; the spatial index is used when built, otherwise the list is scanned
+ * @param p_x Particle x position [m]
+ * @param p_y Particle y position [m]
+ * @param sensor_range Range [m] of sensor, only landmarks this close to the particle are candidates
+ * @param gate Observations farther than gate [m] from every candidate stay unassociated. The
+ *   global method caps the gate at 4 * sensor_range to keep its costs well conditioned.
+ * @param obs_x Observation x coordinates in the map frame
+ * @param obs_y Observation y coordinates in the map frame
+ * @param n_observations Number of observations
+ * @param matches Output array, index into map.landmark_list per observation or -1
+ */
+void associateObservations(AssociationMethod method, const Map& map, double p_x, double p_y,
+		double sensor_range, double gate, const double* obs_x, const double* obs_y, size_t n_observations,
+		int* matches);
+
+#endif /* DATA_ASSOCIATION_H_ */
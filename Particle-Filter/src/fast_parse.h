@@ -0,0 +1,117 @@
+/*
+ * fast_parse.h
+ *
+ * Bounded, allocation-free number parsing over raw character buffers, for
+ * inputs that are not null-terminated (memory-mapped files, socket frames).
+ */
+
+#ifndef FAST_PARSE_H_
+#define FAST_PARSE_H_
+
+#include <math.h>
+
+/*
+ * Advances p past spaces, tabs, commas and line breaks.
+ */
+inline const char* skip_separators(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
+}
+
+/*
+ * Parses a decimal floating point number starting at p.
+ * @param p Start of the number (no leading whitespace)
+ * @param end End of the buffer
+ * @param value Parsed value
+ * @output Position after the number, or p if no number starts there
+ */
+inline const char* parse_double(const char* p, const char* end, double& value) {
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	// Up to 19 significant digits are accumulated exactly, the rest only shift the exponent
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += (mantissa != 0);
+		} else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		p++;
+		for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += (mantissa != 0);
+				exponent--;
+			}
+		}
+	}
+	if (!any) {
+		return start;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		bool exp_negative = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			exp_negative = (*e == '-');
+			e++;
+		}
+		if (e < end && *e >= '0' && *e <= '9') {
+			int exp_value = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++) {
+				exp_value = exp_value < 10000 ? exp_value * 10 + (*e - '0') : exp_value;
+			}
+			exponent += exp_negative ? -exp_value : exp_value;
+			p = e;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0) {
+		result = -exponent <= 22 ? result / pow10[-exponent] : result * pow(10.0, exponent);
+	} else if (exponent > 0) {
+		result = exponent <= 22 ? result * pow10[exponent] : result * pow(10.0, exponent);
+	}
+	value = negative ? -result : result;
+	return p;
+}
+
+/*
+ * Parses a decimal integer starting at p.
+ * @output Position after the number, or p if no number starts there
+ */
+inline const char* parse_int(const char* p, const char* end, int& value) {
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	const char* digits = p;
+	long long result = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		result = result * 10 + (*p - '0');
+	}
+	if (p == digits) {
+		return start;
+	}
+	value = (int)(negative ? -result : result);
+	return p;
+}
+
+#endif /* FAST_PARSE_H_ */
@@ -0,0 +1,142 @@
+/*
+ * filter_engine.cpp
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "filter_engine.h"
+
+using namespace std;
+
+FilterEngine::FilterEngine(const Map& map, const FilterSettings& settings, int num_threads,
+		const StepCallback& on_step, size_t backlog) :
+	map(map), settings(settings), on_step(on_step), backlog(backlog), outstanding(0), stopping(false) {
+	for (int t = 0; t < max(1, num_threads); t++) {
+		workers.push_back(thread(&FilterEngine::work, this));
+	}
+}
+
+FilterEngine::~FilterEngine() {
+	wait();
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+}
+
+bool FilterEngine::submit(Telemetry& telemetry) {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		unique_ptr<Session>& entry = sessions[telemetry.session_id];
+		if (!entry) {
+			entry.reset(new Session(telemetry.session_id, settings.seed, backlog));
+			if (settings.likelihood_field) {
+				entry->pf.setLikelihoodField(settings.likelihood_field);
+			}
+			entry->pf.setRecovery(settings.recovery_alpha_slow, settings.recovery_alpha_fast,
+					settings.recovery_max_injected);
+		}
+		Session& session = *entry;
+		session.closing = false;
+
+		if (session.count == session.pending.size()) {
+			return false;
+		}
+		swap(session.pending[(session.head + session.count) % session.pending.size()], telemetry);
+		session.count++;
+		outstanding++;
+		if (session.scheduled) {
+			return true;
+		}
+		session.scheduled = true;
+		ready.push_back(&session);
+	}
+	work_ready.notify_one();
+	return true;
+}
+
+void FilterEngine::remove(int session_id) {
+	lock_guard<std::mutex> lock(mutex);
+	auto entry = sessions.find(session_id);
+	if (entry == sessions.end()) {
+		return;
+	}
+	// A scheduled session is still referenced by the ready queue or a worker
+	if (entry->second->scheduled) {
+		entry->second->closing = true;
+	} else {
+		sessions.erase(entry);
+	}
+}
+
+void FilterEngine::wait() {
+	unique_lock<std::mutex> lock(mutex);
+	all_done.wait(lock, [this]() { return outstanding == 0; });
+}
+
+size_t FilterEngine::sessionCount() {
+	lock_guard<std::mutex> lock(mutex);
+	return sessions.size();
+}
+
+void FilterEngine::work() {
+	unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		work_ready.wait(lock, [this]() { return stopping || !ready.empty(); });
+		if (ready.empty()) {
+			return;
+		}
+		Session* session = ready.front();
+		ready.pop_front();
+		const Telemetry& telemetry = session->pending[session->head];
+
+		// Run one step outside the lock; the session is not in the ready queue, so no
+		// other worker touches it meanwhile
+		lock.unlock();
+		step(*session, telemetry);
+		lock.lock();
+		session->head = (session->head + 1) % session->pending.size();
+		session->count--;
+
+		// Requeue at the back so busy sessions take turns with the others
+		if (session->count > 0) {
+			ready.push_back(session);
+			work_ready.notify_one();
+		} else {
+			session->scheduled = false;
+			if (session->closing) {
+				sessions.erase(session->id);
+			}
+		}
+		if (--outstanding == 0) {
+			all_done.notify_all();
+		}
+	}
+}
+
+void FilterEngine::step(Session& session, const Telemetry& telemetry) {
+	ParticleFilter& pf = session.pf;
+	if (!pf.initialized()) {
+		// Without a GPS fix there is nothing to start from, wait for one
+		if (!telemetry.has_sense) {
+			return;
+		}
+		// Sense noisy position data from the simulator
+		pf.init(telemetry.sense_x, telemetry.sense_y, telemetry.sense_theta, settings.sigma_pos);
+	}
+	else if (telemetry.has_control) {
+		// Predict the vehicle's next state from previous (noiseless control) data.
+		pf.prediction(settings.delta_t, settings.sigma_pos, telemetry.previous_velocity, telemetry.previous_yawrate);
+	}
+	pf.updateWeights(settings.sensor_range, settings.sigma_landmark, telemetry.observations, map);
+	pf.resample();
+
+	if (on_step) {
+		on_step(session.id, pf);
+	}
+}
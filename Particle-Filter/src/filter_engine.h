@@ -0,0 +1,146 @@
+/*
+ * filter_engine.h
+ *
+ * Runs the particle filters of many vehicles against one shared map on a
+ * pool of worker threads.
+ */
+
+#ifndef FILTER_ENGINE_H_
+#define FILTER_ENGINE_H_
+
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "particle_filter.h"
+#include "telemetry_parser.h"
+
+/*
+ * Parameters every session's filter is run with.
+ */
+struct FilterSettings {
+
+	double delta_t;				// Time elapsed between measurements [s]
+	double sensor_range;		// Sensor range [m]
+	double sigma_pos[3];		// GPS measurement uncertainty [x [m], y [m], theta [rad]]
+	double sigma_landmark[2];	// Landmark measurement uncertainty [x [m], y [m]]
+	uint64_t seed;				// Seed of the filters, each session draws from its own stream
+	const LikelihoodField* likelihood_field;	// Weighting by likelihood field if not nullptr
+	double recovery_alpha_slow;	// Recovery smoothing factors and injection cap, see setRecovery
+	double recovery_alpha_fast;
+	int recovery_max_injected;
+
+	FilterSettings() : delta_t(0.1), sensor_range(50), sigma_pos{0.3, 0.3, 0.01}, sigma_landmark{0.3, 0.3},
+		seed(1), likelihood_field(nullptr), recovery_alpha_slow(0.001), recovery_alpha_fast(0.1),
+		recovery_max_injected(0) {}
+};
+
+/*
+ * Filter sessions addressed by session id. Each session owns a ParticleFilter
+ * and a queue of pending telemetry; the map, its spatial index and the
+ * likelihood field are shared read-only by all sessions. A session is run by
+ * at most one worker at a time, so its steps stay in order, while different
+ * sessions run in parallel.
+ */
+class FilterEngine {
+public:
+
+	/**
+	 * Called on a worker thread after every step with the session id and its filter.
+	 */
+	typedef std::function<void(int, const ParticleFilter&)> StepCallback;
+
+private:
+
+	struct Session {
+		int id;
+		ParticleFilter pf;
+
+		// Ring of pending telemetry; slots keep their observation buffers between
+		// steps. head and count are guarded by the engine mutex, the slot at head is
+		// read by the worker running the session without it.
+		std::vector<Telemetry> pending;
+		size_t head;
+		size_t count;
+		bool scheduled;		// Queued for or being run by a worker
+		bool closing;		// Removed while scheduled, dropped once its steps ran
+
+		Session(int id, uint64_t seed, size_t backlog) : id(id), pf(seed, (uint64_t)id),
+			pending(std::max((size_t)1, backlog)), head(0), count(0), scheduled(false), closing(false) {}
+	};
+
+	const Map& map;
+	FilterSettings settings;
+	StepCallback on_step;
+	size_t backlog;
+
+	// Sessions, the sessions with pending steps in the order they became ready,
+	// and the number of submitted steps not finished yet; guarded by mutex
+	std::unordered_map<int, std::unique_ptr<Session> > sessions;
+	std::deque<Session*> ready;
+	size_t outstanding;
+	bool stopping;
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable all_done;
+
+	std::vector<std::thread> workers;
+
+	FilterEngine(const FilterEngine&);
+	FilterEngine& operator=(const FilterEngine&);
+
+	void work();
+	void step(Session& session, const Telemetry& telemetry);
+
+public:
+
+	/**
+	 * Constructor
+	 * @param map Map shared by all sessions, must outlive the engine and not change
+	 * @param settings Filter parameters
+	 * @param num_threads Number of worker threads
+	 * @param on_step Callback after every step, may be empty
+	 * @param backlog Steps a session can have pending before submit refuses more
+	 */
+	FilterEngine(const Map& map, const FilterSettings& settings, int num_threads,
+			const StepCallback& on_step = StepCallback(), size_t backlog = 16);
+
+	// Destructor, finishes the pending steps and stops the workers
+	~FilterEngine();
+
+	/**
+	 * submit Queues a step for the session telemetry.session_id, creating the session
+	 *   on its first telemetry. The telemetry is swapped into a preallocated slot, so
+	 *   telemetry comes back holding a recycled buffer instead of its contents.
+	 * @param telemetry Decoded telemetry event
+	 * @output False if the session's backlog is full and the step was dropped
+	 */
+	bool submit(Telemetry& telemetry);
+
+	/**
+	 * remove Drops a session and its filter, e.g. when its vehicle disconnected.
+	 *   Steps already submitted still run first; telemetry for the id arriving
+	 *   before then keeps the session, later telemetry starts a new one.
+	 * @param session_id Session to drop
+	 */
+	void remove(int session_id);
+
+	/**
+	 * wait Blocks until every submitted step has finished.
+	 */
+	void wait();
+
+	/**
+	 * sessionCount Returns the number of sessions.
+	 */
+	size_t sessionCount();
+};
+
+#endif /* FILTER_ENGINE_H_ */
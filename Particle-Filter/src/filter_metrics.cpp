@@ -0,0 +1,135 @@
+/*
+ * filter_metrics.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+
+#include "filter_metrics.h"
+
+using namespace std;
+
+FilterMetrics::FilterMetrics(size_t capacity) :
+	samples(max((size_t)1, capacity)), steps(0) {
+	window.reserve(samples.size());
+	values.reserve(samples.size());
+}
+
+void FilterMetrics::record(const FilterStepStats& stats, const double* error) {
+	lock_guard<mutex> lock(samples_mutex);
+	FilterMetricsSample& sample = samples[steps % samples.size()];
+	sample.prediction_ms = stats.prediction_ms;
+	sample.update_ms = stats.update_ms;
+	sample.resample_ms = stats.resample_ms;
+	sample.effective_sample_size = stats.effective_sample_size;
+	sample.num_particles = stats.num_particles;
+	sample.has_error = error != nullptr;
+	for (int k = 0; k < 3; k++) {
+		sample.error[k] = error ? error[k] : 0.0;
+	}
+	steps++;
+}
+
+uint64_t FilterMetrics::stepCount() const {
+	lock_guard<mutex> lock(samples_mutex);
+	return steps;
+}
+
+// Appends one metric line
+static void appendLine(string& out, const char* name, const char* label, double value) {
+	char line[128];
+	if (label) {
+		snprintf(line, sizeof(line), "%s{%s} %.6g\n", name, label, value);
+	} else {
+		snprintf(line, sizeof(line), "%s %.6g\n", name, value);
+	}
+	out += line;
+}
+
+// Appends mean, median, p99 and max of a metric over the window
+static void appendSummary(string& out, const char* name, vector<double>& values) {
+	if (values.empty()) {
+		return;
+	}
+	double sum = 0.0;
+	for (size_t i = 0; i < values.size(); i++) {
+		sum += values[i];
+	}
+	sort(values.begin(), values.end());
+	size_t n = values.size();
+	appendLine(out, name, "stat=\"mean\"", sum / n);
+	appendLine(out, name, "quantile=\"0.5\"", values[n / 2]);
+	appendLine(out, name, "quantile=\"0.99\"", values[min(n - 1, (size_t)(0.99 * n))]);
+	appendLine(out, name, "stat=\"max\"", values[n - 1]);
+}
+
+void FilterMetrics::format(string& out) {
+	uint64_t total;
+	{
+		lock_guard<mutex> lock(samples_mutex);
+		total = steps;
+		size_t n = (size_t)min<uint64_t>(steps, samples.size());
+		window.clear();
+		for (uint64_t s = steps - n; s < steps; s++) {
+			window.push_back(samples[s % samples.size()]);
+		}
+	}
+
+	out.clear();
+	appendLine(out, "pf_steps_total", nullptr, (double)total);
+	appendLine(out, "pf_window_steps", nullptr, (double)window.size());
+	if (window.empty()) {
+		return;
+	}
+	const FilterMetricsSample& last = window.back();
+	appendLine(out, "pf_particles", nullptr, last.num_particles);
+	appendLine(out, "pf_effective_sample_size", nullptr, last.effective_sample_size);
+
+	// Latency and filter health over the window
+	const char* names[4] = { "pf_prediction_ms", "pf_update_ms", "pf_resample_ms",
+			"pf_effective_sample_size_window" };
+	double FilterMetricsSample::* fields[4] = { &FilterMetricsSample::prediction_ms,
+			&FilterMetricsSample::update_ms, &FilterMetricsSample::resample_ms,
+			&FilterMetricsSample::effective_sample_size };
+	for (int f = 0; f < 4; f++) {
+		values.clear();
+		for (size_t i = 0; i < window.size(); i++) {
+			values.push_back(window[i].*fields[f]);
+		}
+		appendSummary(out, names[f], values);
+	}
+	values.clear();
+	for (size_t i = 0; i < window.size(); i++) {
+		values.push_back(window[i].num_particles);
+	}
+	appendSummary(out, "pf_particles_window", values);
+
+	// Accuracy, only over the steps that had ground truth
+	const char* error_names[3] = { "pf_error_x", "pf_error_y", "pf_error_yaw" };
+	for (int k = 0; k < 3; k++) {
+		values.clear();
+		for (size_t i = 0; i < window.size(); i++) {
+			if (window[i].has_error) {
+				values.push_back(window[i].error[k]);
+			}
+		}
+		appendSummary(out, error_names[k], values);
+	}
+}
+
+bool FilterMetrics::writeFile(const string& filename) {
+	string text;
+	format(text);
+	string tmp_name = filename + ".tmp";
+	FILE* out = fopen(tmp_name.c_str(), "w");
+	if (!out) {
+		return false;
+	}
+	bool written = fwrite(text.data(), 1, text.size(), out) == text.size();
+	written = fclose(out) == 0 && written;
+	if (!written || rename(tmp_name.c_str(), filename.c_str()) != 0) {
+		remove(tmp_name.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * filter_metrics.h
+ *
+ * Per-step latency and accuracy metrics of the particle filter, kept in a
+ * preallocated ring buffer and exported as text on demand.
+ */
+
+#ifndef FILTER_METRICS_H_
+#define FILTER_METRICS_H_
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "particle_filter.h"
+
+/*
+ * Metrics recorded for one filter step.
+ */
+struct FilterMetricsSample {
+
+	double prediction_ms;	// Wall time spent in prediction [ms]
+	double update_ms;		// Wall time spent in updateWeights [ms]
+	double resample_ms;		// Wall time spent in resample [ms]
+	double effective_sample_size;	// Effective sample size of the updated weights
+	int num_particles;		// Particle count after resampling
+	bool has_error;			// Whether ground truth was available for the step
+	double error[3];		// Error of the best particle versus ground truth [x, y, yaw]
+};
+
+/*
+ * Ring buffer of the most recent filter steps. record() is called by the thread
+ * running the filter and only copies one sample under a short lock; the
+ * window statistics are computed by the exporting thread in format().
+ */
+class FilterMetrics {
+
+	// Ring of the last samples.size() steps
+	std::vector<FilterMetricsSample> samples;
+	uint64_t steps;
+	mutable std::mutex samples_mutex;
+
+	// Copy of the window and a sort buffer, reused between exports
+	std::vector<FilterMetricsSample> window;
+	std::vector<double> values;
+
+	FilterMetrics(const FilterMetrics&);
+	FilterMetrics& operator=(const FilterMetrics&);
+
+public:
+
+	/**
+	 * Constructor
+	 * @param capacity Number of most recent steps the statistics are computed over
+	 */
+	explicit FilterMetrics(size_t capacity = 1024);
+
+	/**
+	 * record Stores the metrics of the filter step that just finished.
+	 * @param stats Step statistics of the filter
+	 * @param error Error of the best particle versus ground truth [x, y, yaw],
+	 *   or nullptr if there is no ground truth
+	 */
+	void record(const FilterStepStats& stats, const double* error = nullptr);
+
+	/**
+	 * stepCount Returns the number of steps recorded so far.
+	 */
+	uint64_t stepCount() const;
+
+	/**
+	 * format Writes the window statistics as Prometheus-style text lines.
+	 *   Only one thread may export at a time.
+	 * @param out Receives the text, its buffer is reused
+	 */
+	void format(std::string& out);
+
+	/**
+	 * writeFile Writes the output of format() to a file, replacing it atomically.
+	 * @param filename Name of the file
+	 * @output True if writing the file was successful
+	 */
+	bool writeFile(const std::string& filename);
+};
+
+#endif /* FILTER_METRICS_H_ */
@@ -0,0 +1,164 @@
+/*
+ * filter_random.h
+ *
+ * Counter-based random number generation for the particle filter.
+ */
+
+#ifndef FILTER_RANDOM_H_
+#define FILTER_RANDOM_H_
+
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers:
+ * as easy as 1, 2, 3", SC 2011). Every 128-bit counter value is encrypted with a
+ * 64-bit key into four independent 32-bit outputs, so the sequence is fully
+ * determined by (seed, stream, position) and distinct streams never overlap.
+ * Satisfies the standard UniformRandomBitGenerator requirements.
+ */
+class Philox4x32 {
+
+	uint32_t key[2];
+	uint32_t counter[4];
+
+	// Outputs of the current block and the next one to hand out
+	uint32_t output[4];
+	int next;
+
+	static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+		uint64_t product = (uint64_t)a * b;
+		hi = (uint32_t)(product >> 32);
+		lo = (uint32_t)product;
+	}
+
+	void increment() {
+		if (++counter[0] == 0) {
+			++counter[1];
+		}
+	}
+
+public:
+
+	typedef uint32_t result_type;
+
+	/**
+	 * Constructor
+	 * @param seed Key of the generator
+	 * @param stream Independent sequence to draw from for the same seed
+	 */
+	explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0) : next(4) {
+		key[0] = (uint32_t)seed;
+		key[1] = (uint32_t)(seed >> 32);
+		counter[0] = 0;
+		counter[1] = 0;
+		counter[2] = (uint32_t)stream;
+		counter[3] = (uint32_t)(stream >> 32);
+	}
+
+	static result_type min() {
+		return 0;
+	}
+
+	static result_type max() {
+		return 0xFFFFFFFFu;
+	}
+
+	/**
+	 * block Writes the four outputs of the next counter value.
+	 */
+	void block(uint32_t out[4]) {
+		uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+		uint32_t k0 = key[0], k1 = key[1];
+		for (int round = 0; round < 10; round++) {
+			uint32_t hi0, lo0, hi1, lo1;
+			mulhilo(0xD2511F53u, c0, hi0, lo0);
+			mulhilo(0xCD9E8D57u, c2, hi1, lo1);
+			c0 = hi1 ^ c1 ^ k0;
+			c1 = lo1;
+			c2 = hi0 ^ c3 ^ k1;
+			c3 = lo0;
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+		increment();
+	}
+
+	result_type operator()() {
+		if (next == 4) {
+			block(output);
+			next = 0;
+		}
+		return output[next++];
+	}
+};
+
+/*
+ * Random draws used by the particle filter, on top of a Philox stream.
+ * Gaussian noise is produced in bulk for a whole batch of particles, without
+ * the per-call state handling of std::normal_distribution.
+ */
+class FilterRandom {
+
+	Philox4x32 engine;
+
+public:
+
+	/**
+	 * Constructor
+	 * @param seed Seed of the random stream
+	 * @param stream Independent stream for the same seed, e.g. one per filter
+	 */
+	explicit FilterRandom(uint64_t seed = 1, uint64_t stream = 0) : engine(seed, stream) {}
+
+	/**
+	 * uniform Returns a uniform draw in [0, 1).
+	 */
+	double uniform() {
+		uint32_t a = engine() >> 5;
+		uint32_t b = engine() >> 6;
+		return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+	}
+
+	/**
+	 * gaussian Fills an array with standard normal draws.
+	 * @param out Output array
+	 * @param n Number of draws
+	 */
+	void gaussian(double* out, size_t n) {
+		// Marsaglia's polar method on the four outputs of a Philox block at a time:
+		// two points in the unit square, each accepted one turning into two normals
+		const double scale = 2.0 / 4294967296.0;
+		uint32_t bits[4];
+		size_t i = 0;
+		while (i < n) {
+			engine.block(bits);
+			for (int h = 0; h < 4 && i < n; h += 2) {
+				double v1 = bits[h] * scale - 1.0;
+				double v2 = bits[h + 1] * scale - 1.0;
+				double s = v1 * v1 + v2 * v2;
+				if (s < 1.0 && s > 0.0) {
+					double f = sqrt(-2.0 * log(s) / s);
+					out[i++] = v1 * f;
+					if (i < n) {
+						out[i++] = v2 * f;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * uniformBits Returns the underlying generator, e.g. for standard distributions.
+	 */
+	Philox4x32& uniformBits() {
+		return engine;
+	}
+};
+
+#endif /* FILTER_RANDOM_H_ */
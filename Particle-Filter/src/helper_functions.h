@@ -53,8 +53,12 @@ inline double dist(double x1, double y1, double x2, double y2) {
 	return sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
 }
 
-inline double * getError(double gt_x, double gt_y, double gt_theta, double pf_x, double pf_y, double pf_theta) {
-	static double error[3];
+/*
+ * Computes the x, y and yaw errors of an estimate into error, which the caller
+ * owns, so it may be called from several threads at once.
+ */
+inline void getError(double gt_x, double gt_y, double gt_theta, double pf_x, double pf_y, double pf_theta,
+		double error[3]) {
 	error[0] = fabs(pf_x - gt_x);
 	error[1] = fabs(pf_y - gt_y);
 	error[2] = fabs(pf_theta - gt_theta);
@@ -62,6 +66,15 @@ inline double * getError(double gt_x, double gt_y, double gt_theta, double pf_x,
 	if (error[2] > M_PI) {
 		error[2] = 2.0 * M_PI - error[2];
 	}
+}
+
+/*
+ * As above, into a static buffer that the next call overwrites; single-threaded
+ * callers only.
+ */
+inline double * getError(double gt_x, double gt_y, double gt_theta, double pf_x, double pf_y, double pf_theta) {
+	static double error[3];
+	getError(gt_x, gt_y, gt_theta, pf_x, pf_y, pf_theta, error);
 	return error;
 }
 
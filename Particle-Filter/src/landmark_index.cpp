@@ -0,0 +1,190 @@
+/*
+ * landmark_index.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "landmark_index.h"
+
+using namespace std;
+
+void LandmarkIndex::finalize(double cell_size) {
+	size_t n = xs.size();
+	cell_start.clear();
+	ids.clear();
+	if (n == 0) {
+		nx = ny = 0;
+		return;
+	}
+
+	double max_x = xs[0], max_y = ys[0];
+	min_x = xs[0];
+	min_y = ys[0];
+	for (size_t i = 1; i < n; i++) {
+		min_x = min(min_x, (double)xs[i]);
+		min_y = min(min_y, (double)ys[i]);
+		max_x = max(max_x, (double)xs[i]);
+		max_y = max(max_y, (double)ys[i]);
+	}
+	double width = max(max_x - min_x, 1e-3);
+	double height = max(max_y - min_y, 1e-3);
+
+	// Default to about two landmarks per cell, and never use more cells than
+	// four per landmark so sparse maps do not blow up the cell table
+	if (cell_size <= 0) {
+		cell_size = sqrt(2.0 * width * height / n);
+	}
+	while ((width / cell_size + 1) * (height / cell_size + 1) > 4.0 * n + 16) {
+		cell_size *= 2;
+	}
+	this->cell_size = cell_size;
+	inv_cell_size = 1.0 / cell_size;
+	nx = (int)(width * inv_cell_size) + 1;
+	ny = (int)(height * inv_cell_size) + 1;
+
+	// Counting sort of the landmarks by cell
+	vector<int> cell_of(n);
+	cell_start.assign(nx * ny + 1, 0);
+	for (size_t i = 0; i < n; i++) {
+		cell_of[i] = cellY(ys[i]) * nx + cellX(xs[i]);
+		cell_start[cell_of[i] + 1]++;
+	}
+	for (int c = 0; c < nx * ny; c++) {
+		cell_start[c + 1] += cell_start[c];
+	}
+
+	vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+	vector<float> sorted_x(n), sorted_y(n);
+	ids.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		int k = fill[cell_of[i]]++;
+		sorted_x[k] = xs[i];
+		sorted_y[k] = ys[i];
+		ids[k] = (int)i;
+	}
+	xs.swap(sorted_x);
+	ys.swap(sorted_y);
+}
+
+int LandmarkIndex::nearest(double x, double y, double max_dist, double cx, double cy, double range) const {
+	if (empty()) {
+		return -1;
+	}
+	// A landmark within range of (cx, cy) is no farther from (x, y) than this,
+	// so an empty neighbourhood does not send the search across the whole grid
+	max_dist = min(max_dist, range + hypot(x - cx, y - cy));
+	int best = -1;
+	double best_d2 = max_dist * max_dist;
+	double range2 = range * range;
+
+	int ox = cellX(x), oy = cellY(y);
+	// Rings needed to cover max_dist, bounded by the grid itself
+	int max_ring = max(nx, ny);
+	if (max_dist * inv_cell_size < max_ring) {
+		max_ring = (int)ceil(max_dist * inv_cell_size);
+	}
+
+	for (int ring = 0; ring <= max_ring; ring++) {
+		// Every cell of this ring is at least (ring - 1) cells away from the query point
+		if (ring > 1) {
+			double ring_dist = (ring - 1) * cell_size;
+			if (ring_dist * ring_dist > best_d2) {
+				break;
+			}
+		}
+		for (int gy = oy - ring; gy <= oy + ring; gy++) {
+			if (gy < 0 || gy >= ny) {
+				continue;
+			}
+			bool edge_row = (gy == oy - ring || gy == oy + ring);
+			int step = edge_row ? 1 : 2 * ring;
+			for (int gx = ox - ring; gx <= ox + ring; gx += (step > 0 ? step : 1)) {
+				if (gx < 0 || gx >= nx) {
+					continue;
+				}
+				int c = gy * nx + gx;
+				for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+					double dx = xs[k] - x;
+					double dy = ys[k] - y;
+					double d2 = dx * dx + dy * dy;
+					if (d2 < best_d2) {
+						double rx = xs[k] - cx;
+						double ry = ys[k] - cy;
+						if (rx * rx + ry * ry <= range2) {
+							best_d2 = d2;
+							best = ids[k];
+						}
+					}
+				}
+			}
+		}
+	}
+	return best;
+}
+
+// Flat layout: min_x, min_y, cell_size, nx, ny, landmark count, then the cell
+// offsets, coordinates and landmark indices
+
+size_t LandmarkIndex::serializedSize() const {
+	return 3 * sizeof(double) + 3 * sizeof(int) + cell_start.size() * sizeof(int) +
+			xs.size() * sizeof(float) + ys.size() * sizeof(float) + ids.size() * sizeof(int);
+}
+
+template <typename T>
+static char* writeArray(char* out, const T* data, size_t n) {
+	memcpy(out, data, n * sizeof(T));
+	return out + n * sizeof(T);
+}
+
+template <typename T>
+static const char* readArray(const char* in, T* data, size_t n) {
+	memcpy(data, in, n * sizeof(T));
+	return in + n * sizeof(T);
+}
+
+void LandmarkIndex::serialize(char* out) const {
+	double origin[3] = { min_x, min_y, cell_size };
+	int dims[3] = { nx, ny, (int)ids.size() };
+	out = writeArray(out, origin, 3);
+	out = writeArray(out, dims, 3);
+	out = writeArray(out, cell_start.data(), cell_start.size());
+	out = writeArray(out, xs.data(), xs.size());
+	out = writeArray(out, ys.data(), ys.size());
+	writeArray(out, ids.data(), ids.size());
+}
+
+bool LandmarkIndex::deserialize(const char* in, size_t size) {
+	const size_t header = 3 * sizeof(double) + 3 * sizeof(int);
+	if (size < header) {
+		return false;
+	}
+	double origin[3];
+	int dims[3];
+	in = readArray(in, origin, 3);
+	in = readArray(in, dims, 3);
+	if (dims[0] < 0 || dims[1] < 0 || dims[2] < 0 || origin[2] <= 0) {
+		return false;
+	}
+	size_t cells = dims[2] > 0 ? (size_t)dims[0] * dims[1] + 1 : 0;
+	if (size != header + (cells + (size_t)dims[2]) * sizeof(int) + 2 * (size_t)dims[2] * sizeof(float)) {
+		return false;
+	}
+
+	min_x = origin[0];
+	min_y = origin[1];
+	cell_size = origin[2];
+	inv_cell_size = 1.0 / cell_size;
+	nx = dims[0];
+	ny = dims[1];
+	cell_start.resize(cells);
+	xs.resize(dims[2]);
+	ys.resize(dims[2]);
+	ids.resize(dims[2]);
+	in = readArray(in, cell_start.data(), cells);
+	in = readArray(in, xs.data(), xs.size());
+	in = readArray(in, ys.data(), ys.size());
+	readArray(in, ids.data(), ids.size());
+	return cells == 0 || (cell_start[0] == 0 && cell_start[cells - 1] == dims[2]);
+}
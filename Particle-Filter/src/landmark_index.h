@@ -0,0 +1,137 @@
+/*
+ * landmark_index.h
+ *
+ * Uniform grid spatial index over the map landmarks.
+ */
+
+#ifndef LANDMARK_INDEX_H_
+#define LANDMARK_INDEX_H_
+
+#include <cmath>
+#include <vector>
+
+/*
+ * Landmarks bucketed into square cells and stored cell by cell (compressed
+ * row layout), so range and nearest-neighbour queries touch only the cells
+ * around the query point and never allocate.
+ */
+class LandmarkIndex {
+
+	// Grid origin, cell size and dimensions
+	double min_x;
+	double min_y;
+	double cell_size;
+	double inv_cell_size;
+	int nx;
+	int ny;
+
+	// Landmarks of cell c are stored at [cell_start[c], cell_start[c + 1])
+	std::vector<int> cell_start;
+
+	// Landmark coordinates and index into the map's landmark_list, in cell order
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<int> ids;
+
+	int cellX(double x) const {
+		int c = (int)floor((x - min_x) * inv_cell_size);
+		return c < 0 ? 0 : (c >= nx ? nx - 1 : c);
+	}
+
+	int cellY(double y) const {
+		int c = (int)floor((y - min_y) * inv_cell_size);
+		return c < 0 ? 0 : (c >= ny ? ny - 1 : c);
+	}
+
+	/**
+	 * finalize Buckets the landmarks loaded into xs/ys by cell.
+	 * @param cell_size Cell size [m], chosen from the landmark density if <= 0
+	 */
+	void finalize(double cell_size);
+
+public:
+
+	LandmarkIndex() : min_x(0), min_y(0), cell_size(1), inv_cell_size(1), nx(0), ny(0) {}
+
+	/**
+	 * build Indexes a landmark list.
+	 * @param landmarks Landmarks with x_f/y_f map coordinates
+	 * @param cell_size Cell size [m], chosen from the landmark density if <= 0
+	 */
+	template <typename Landmark>
+	void build(const std::vector<Landmark>& landmarks, double cell_size) {
+		xs.resize(landmarks.size());
+		ys.resize(landmarks.size());
+		for (size_t i = 0; i < landmarks.size(); i++) {
+			xs[i] = landmarks[i].x_f;
+			ys[i] = landmarks[i].y_f;
+		}
+		finalize(cell_size);
+	}
+
+	/**
+	 * empty Returns whether the index has been built.
+	 */
+	bool empty() const {
+		return cell_start.empty();
+	}
+
+	size_t size() const {
+		return ids.size();
+	}
+
+	double cellSize() const {
+		return cell_size;
+	}
+
+	/**
+	 * serializedSize Size [bytes] of the flat binary form written by serialize.
+	 */
+	size_t serializedSize() const;
+
+	/**
+	 * serialize Writes the index to out, which must hold serializedSize() bytes.
+	 */
+	void serialize(char* out) const;
+
+	/**
+	 * deserialize Restores an index written by serialize.
+	 * @output True if the buffer held a consistent index
+	 */
+	bool deserialize(const char* in, size_t size);
+
+	/**
+	 * forEachInRadius Calls visit(landmark_index, x, y) for every landmark within
+	 *   radius of (x, y).
+	 */
+	template <typename Visitor>
+	void forEachInRadius(double x, double y, double radius, Visitor visit) const {
+		if (empty()) {
+			return;
+		}
+		int cx0 = cellX(x - radius), cx1 = cellX(x + radius);
+		int cy0 = cellY(y - radius), cy1 = cellY(y + radius);
+		double r2 = radius * radius;
+		for (int cy = cy0; cy <= cy1; cy++) {
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int c = cy * nx + cx;
+				for (int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+					double dx = xs[k] - x;
+					double dy = ys[k] - y;
+					if (dx * dx + dy * dy <= r2) {
+						visit(ids[k], (double)xs[k], (double)ys[k]);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * nearest Finds the landmark closest to (x, y) within max_dist that also lies
+	 *   within range of (cx, cy), searching rings of cells outward from (x, y).
+	 * @output Index of the landmark in the map's landmark_list, -1 if none qualifies
+	 */
+	int nearest(double x, double y, double max_dist, double cx, double cy, double range) const;
+};
+
+#endif /* LANDMARK_INDEX_H_ */
@@ -0,0 +1,186 @@
+/*
+ * likelihood_field.cpp
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "likelihood_field.h"
+
+using namespace std;
+
+// Largest grid build() allocates, about 512 MB of likelihoods
+static const size_t kMaxCells = (size_t)1 << 27;
+
+// Squared distance standing in for "no landmark" in the transform
+static const double kFar = numeric_limits<double>::max();
+
+bool LikelihoodField::build(const Map& map, double resolution, const double std_landmark[],
+		double max_distance) {
+	const vector<Map::single_landmark_s>& landmarks = map.landmark_list;
+	log_likelihood.clear();
+	nx = ny = 0;
+	if (landmarks.empty() || resolution <= 0 || max_distance <= 0 ||
+			std_landmark[0] <= 0 || std_landmark[1] <= 0) {
+		return false;
+	}
+
+	double max_x = landmarks[0].x_f, max_y = landmarks[0].y_f;
+	min_x = landmarks[0].x_f;
+	min_y = landmarks[0].y_f;
+	for (size_t i = 1; i < landmarks.size(); i++) {
+		min_x = min(min_x, (double)landmarks[i].x_f);
+		min_y = min(min_y, (double)landmarks[i].y_f);
+		max_x = max(max_x, (double)landmarks[i].x_f);
+		max_y = max(max_y, (double)landmarks[i].y_f);
+	}
+	min_x -= max_distance;
+	min_y -= max_distance;
+	max_x += max_distance;
+	max_y += max_distance;
+
+	double cells_x = ceil((max_x - min_x) / resolution);
+	double cells_y = ceil((max_y - min_y) / resolution);
+	if (cells_x * cells_y > (double)kMaxCells) {
+		return false;
+	}
+	this->resolution = resolution;
+	inv_resolution = 1.0 / resolution;
+	int w = (int)cells_x;
+	int h = (int)cells_y;
+	size_t cells = (size_t)w * h;
+
+	// Landmark seeded in each cell, -1 for none. Several landmarks in one cell
+	// keep the first; the exact distances below still use its true position.
+	vector<int> seed(cells, -1);
+	for (size_t i = 0; i < landmarks.size(); i++) {
+		int cx = min(w - 1, (int)((landmarks[i].x_f - min_x) * inv_resolution));
+		int cy = min(h - 1, (int)((landmarks[i].y_f - min_y) * inv_resolution));
+		int& s = seed[(size_t)cy * w + cx];
+		if (s < 0) {
+			s = (int)i;
+		}
+	}
+
+	// Pass 1: per column, the row of the nearest seed in that column
+	vector<int> site_row(cells, -1);
+	for (int x = 0; x < w; x++) {
+		int last = -1;
+		for (int y = 0; y < h; y++) {
+			if (seed[(size_t)y * w + x] >= 0) {
+				last = y;
+			}
+			site_row[(size_t)y * w + x] = last;
+		}
+		last = -1;
+		for (int y = h - 1; y >= 0; y--) {
+			size_t c = (size_t)y * w + x;
+			if (seed[c] >= 0) {
+				last = y;
+			}
+			if (last >= 0 && (site_row[c] < 0 || last - y < y - site_row[c])) {
+				site_row[c] = last;
+			}
+		}
+	}
+
+	// Pass 2: per row, lower envelope of the parabolas (x - q)^2 + dy(q)^2 over the
+	// columns q that have a seed, which gives the nearest seed of every cell
+	vector<int> nearest(cells, -1);
+	vector<int> v(w);
+	vector<double> z(w + 1);
+	vector<double> f(w);
+	for (int y = 0; y < h; y++) {
+		const int* rows = &site_row[(size_t)y * w];
+		for (int q = 0; q < w; q++) {
+			double dy = rows[q] < 0 ? 0 : rows[q] - y;
+			f[q] = rows[q] < 0 ? kFar : dy * dy;
+		}
+
+		int k = -1;
+		for (int q = 0; q < w; q++) {
+			if (f[q] == kFar) {
+				continue;
+			}
+			if (k < 0) {
+				k = 0;
+				v[0] = q;
+				z[0] = -kFar;
+				z[1] = kFar;
+				continue;
+			}
+			// z[0] is -infinity, so the envelope never pops its first parabola
+			double s;
+			for (;;) {
+				int p = v[k];
+				s = ((f[q] + (double)q * q) - (f[p] + (double)p * p)) / (2.0 * (q - p));
+				if (s > z[k]) {
+					break;
+				}
+				k--;
+			}
+			k++;
+			v[k] = q;
+			z[k] = s;
+			z[k + 1] = kFar;
+		}
+		if (k < 0) {
+			continue;
+		}
+
+		int j = 0;
+		for (int x = 0; x < w; x++) {
+			while (z[j + 1] < x) {
+				j++;
+			}
+			int q = v[j];
+			nearest[(size_t)y * w + x] = seed[(size_t)rows[q] * w + q];
+		}
+	}
+
+	// Log-likelihood of the nearest landmark seen from each cell centre
+	double std_x = std_landmark[0];
+	double std_y = std_landmark[1];
+	double log_norm = -log(2 * M_PI * std_x * std_y);
+	double miss_offset2 = max_distance * max_distance / 2;
+	miss_log_likelihood = (float)(log_norm - (miss_offset2 / (2 * std_x * std_x) + miss_offset2 / (2 * std_y * std_y)));
+	double max_distance2 = max_distance * max_distance;
+
+	// The transform runs on landmarks snapped to cells, so near ties can pick a
+	// landmark slightly farther than the true nearest one; the exact distance to
+	// the candidates of the cell and its four neighbours settles them
+	log_likelihood.assign(cells, miss_log_likelihood);
+	const int offsets[5][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	for (int y = 0; y < h; y++) {
+		double cy = min_y + (y + 0.5) * resolution;
+		for (int x = 0; x < w; x++) {
+			double cx = min_x + (x + 0.5) * resolution;
+			double best_dx = 0, best_dy = 0, best_d2 = kFar;
+			for (int o = 0; o < 5; o++) {
+				int qx = x + offsets[o][0];
+				int qy = y + offsets[o][1];
+				if (qx < 0 || qy < 0 || qx >= w || qy >= h) {
+					continue;
+				}
+				int k = nearest[(size_t)qy * w + qx];
+				if (k < 0) {
+					continue;
+				}
+				double dx = landmarks[k].x_f - cx;
+				double dy = landmarks[k].y_f - cy;
+				if (dx * dx + dy * dy < best_d2) {
+					best_d2 = dx * dx + dy * dy;
+					best_dx = dx;
+					best_dy = dy;
+				}
+			}
+			if (best_d2 <= max_distance2) {
+				log_likelihood[(size_t)y * w + x] = (float)(log_norm -
+						(best_dx * best_dx / (2 * std_x * std_x) + best_dy * best_dy / (2 * std_y * std_y)));
+			}
+		}
+	}
+	nx = w;
+	ny = h;
+	return true;
+}
@@ -0,0 +1,90 @@
+/*
+ * likelihood_field.h
+ *
+ * Precomputed observation likelihood over a grid covering the map, so a
+ * particle can be weighted without associating its observations.
+ */
+
+#ifndef LIKELIHOOD_FIELD_H_
+#define LIKELIHOOD_FIELD_H_
+
+#include <cmath>
+#include <stddef.h>
+#include <vector>
+
+#include "helper_functions.h"
+
+/*
+ * Grid of square cells storing, for a map-frame observation falling into the
+ * cell, the log of the bivariate Gaussian likelihood of the nearest landmark.
+ * The nearest landmark of every cell is found with an exact Euclidean feature
+ * transform of the landmark grid at build time; lookups are then a single
+ * table read. Observations farther than max_distance from every landmark, or
+ * outside the grid, get the likelihood of a miss at max_distance, the same
+ * penalty updateWeights applies to observations outside the association gate.
+ */
+class LikelihoodField {
+
+	// Grid origin, resolution and dimensions
+	double min_x;
+	double min_y;
+	double resolution;
+	double inv_resolution;
+	int nx;
+	int ny;
+
+	// Log-likelihood per cell, row by row, and for observations beyond max_distance
+	std::vector<float> log_likelihood;
+	float miss_log_likelihood;
+
+public:
+
+	LikelihoodField() : min_x(0), min_y(0), resolution(1), inv_resolution(1), nx(0), ny(0),
+		miss_log_likelihood(0) {}
+
+	/**
+	 * build Computes the field for a map.
+	 * @param map Map landmarks
+	 * @param resolution Cell size [m]
+	 * @param std_landmark[] Array of dimension 2 [Landmark measurement uncertainty [x [m], y [m]]]
+	 * @param max_distance Distance [m] beyond which observations count as misses; also the
+	 *   margin the grid extends past the outermost landmarks
+	 * @output True if the field was built, false for an empty map, invalid parameters or a
+	 *   grid too large to allocate
+	 */
+	bool build(const Map& map, double resolution, const double std_landmark[], double max_distance);
+
+	/**
+	 * empty Returns whether the field has been built.
+	 */
+	bool empty() const {
+		return log_likelihood.empty();
+	}
+
+	double cellSize() const {
+		return resolution;
+	}
+
+	/**
+	 * memoryBytes Returns the size of the likelihood table [bytes].
+	 */
+	size_t memoryBytes() const {
+		return log_likelihood.size() * sizeof(float);
+	}
+
+	/**
+	 * logLikelihood Returns the log-likelihood of an observation at a map position.
+	 * @param x Map x coordinate [m]
+	 * @param y Map y coordinate [m]
+	 */
+	float logLikelihood(double x, double y) const {
+		double fx = (x - min_x) * inv_resolution;
+		double fy = (y - min_y) * inv_resolution;
+		if (!(fx >= 0 && fy >= 0 && fx < nx && fy < ny)) {
+			return miss_log_likelihood;
+		}
+		return log_likelihood[(size_t)(int)fy * nx + (int)fx];
+	}
+};
+
+#endif /* LIKELIHOOD_FIELD_H_ */
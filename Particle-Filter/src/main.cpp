@@ -2,27 +2,51 @@
 #include <iostream>
 #include "json.hpp"
 #include <math.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "filter_engine.h"
+#include "filter_metrics.h"
+#include "map_loader.h"
 #include "particle_filter.h"
+#include "telemetry_parser.h"
 
 using namespace std;
 
 // for convenience
 using json = nlohmann::json;
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_first_of("]");
-  if (found_null != std::string::npos) {
-    return "";
+// Encoded reply of one session step, handed from a filter worker to the socket thread
+struct SessionReply {
+  int session_id;
+  std::string msg;
+};
+
+// State shared between the socket thread, the filter workers and the async wake-up
+struct ReplyQueue {
+  std::mutex mutex;
+  std::vector<SessionReply> posted;
+  // Replies being sent, swapped with posted so both buffers are reused
+  std::vector<SessionReply> sending;
+  // Socket each session's replies go to, only touched on the socket thread
+  std::unordered_map<int, uWS::WebSocket<uWS::SERVER> > sockets;
+};
+
+// Runs on the socket thread whenever filter workers have posted replies
+static void sendReplies(uS::Async *async) {
+  ReplyQueue *replies = static_cast<ReplyQueue *>(async->getData());
+  {
+    std::lock_guard<std::mutex> lock(replies->mutex);
+    replies->sending.swap(replies->posted);
   }
-  else if (b1 != std::string::npos && b2 != std::string::npos) {
-    return s.substr(b1, b2 - b1 + 1);
+  for (size_t i = 0; i < replies->sending.size(); i++) {
+    const SessionReply &reply = replies->sending[i];
+    auto socket = replies->sockets.find(reply.session_id);
+    if (socket != replies->sockets.end()) {
+      socket->second.send(reply.msg.data(), reply.msg.length(), uWS::OpCode::TEXT);
+    }
   }
-  return "";
+  replies->sending.clear();
 }
 
 int main()
@@ -30,137 +54,125 @@ int main()
   uWS::Hub h;
 
   //Set up parameters here
-  double delta_t = 0.1; // Time elapsed between measurements [sec]
-  double sensor_range = 50; // Sensor range [m]
-
-  double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
-  double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
+  FilterSettings settings;
+  settings.delta_t = 0.1; // Time elapsed between measurements [sec]
+  settings.sensor_range = 50; // Sensor range [m]
+  // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+  settings.sigma_pos[0] = 0.3;
+  settings.sigma_pos[1] = 0.3;
+  settings.sigma_pos[2] = 0.01;
+  // Landmark measurement uncertainty [x [m], y [m]]
+  settings.sigma_landmark[0] = 0.3;
+  settings.sigma_landmark[1] = 0.3;
+  // Recover from divergence without a restart
+  settings.recovery_alpha_slow = 0.001; // Smoothing of the long-term likelihood average for recovery
+  settings.recovery_alpha_fast = 0.1; // Smoothing of the short-term likelihood average for recovery
+  settings.recovery_max_injected = 10; // Particles recovery may inject per step, 0 disables it
+  double likelihood_field_resolution = 0; // Likelihood field cell size [m], 0 weights by landmark association
+  double likelihood_field_max_distance = 5.0; // Distance beyond which an observation counts as a miss [m]
+  int num_threads = std::max(1u, std::thread::hardware_concurrency()); // Filter workers shared by all vehicles
 
   // Read map data
   Map map;
-  if (!read_map_data("../data/map_data.txt", map)) {
+  if (!read_map_data_cached("../data/map_data.txt", map)) {
 	  cout << "Error: Could not open map file" << endl;
 	  return -1;
   }
 
-  // Create particle filter
-  ParticleFilter pf;
+  LikelihoodField likelihood_field;
+  if (likelihood_field_resolution > 0) {
+	  if (!likelihood_field.build(map, likelihood_field_resolution, settings.sigma_landmark, likelihood_field_max_distance)) {
+		  cout << "Error: Could not build likelihood field" << endl;
+		  return -1;
+	  }
+	  settings.likelihood_field = &likelihood_field;
+  }
+
+  // Recent step timings and filter health, served at /metrics
+  FilterMetrics metrics(1024);
+  std::string metrics_text;
+
+  // Every vehicle (session_id in its telemetry, 0 for the simulator) gets its own
+  // particle filter on the shared map. Telemetry is decoded on the socket thread
+  // and handed to the engine's workers; their replies come back through an async
+  // wake-up of the socket loop, so socket I/O never waits on a filter.
+  ReplyQueue replies;
+  uS::Async *async = new uS::Async(h.getLoop());
+  async->setData(&replies);
+  async->start(sendReplies);
+
+  FilterEngine engine(map, settings, num_threads, [&metrics,&replies,async](int session_id, const ParticleFilter &pf) {
+    // Best particle and weight statistics are gathered by updateWeights, the
+    // simulator keeps the ground truth so no error is recorded here
+    metrics.record(pf.stepStats());
+    const Particle &best_particle = pf.bestParticle();
+
+    json msgJson;
+    msgJson["best_particle_x"] = best_particle.x;
+    msgJson["best_particle_y"] = best_particle.y;
+    msgJson["best_particle_theta"] = best_particle.theta;
+    if (session_id != 0) {
+      msgJson["session_id"] = session_id;
+    }
+
+    //Optional message data used for debugging particle's sensing and associations
+    msgJson["best_particle_associations"] = pf.getAssociations(best_particle);
+    msgJson["best_particle_sense_x"] = pf.getSenseX(best_particle);
+    msgJson["best_particle_sense_y"] = pf.getSenseY(best_particle);
+
+    {
+      std::lock_guard<std::mutex> lock(replies.mutex);
+      replies.posted.push_back(SessionReply());
+      replies.posted.back().session_id = session_id;
+      replies.posted.back().msg = "42[\"best_particle\"," + msgJson.dump() + "]";
+    }
+    async->send();
+  });
+
+  // Decoded telemetry, its observation buffer is swapped with a recycled one on submit
+  Telemetry telemetry;
 
-  h.onMessage([&pf,&map,&delta_t,&sensor_range,&sigma_pos,&sigma_landmark](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+  h.onMessage([&engine,&replies,&telemetry](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
 
-    if (length && length > 2 && data[0] == '4' && data[1] == '2')
-    {
+    TelemetryMessage message = parse_telemetry(data, length, telemetry);
 
-      auto s = hasData(std::string(data));
-      if (s != "") {
-      	
-      	
-        auto j = json::parse(s);
-        std::string event = j[0].get<std::string>();
-        
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-
-
-          if (!pf.initialized()) {
-
-          	// Sense noisy position data from the simulator
-			double sense_x = std::stod(j[1]["sense_x"].get<std::string>());
-			double sense_y = std::stod(j[1]["sense_y"].get<std::string>());
-			double sense_theta = std::stod(j[1]["sense_theta"].get<std::string>());
-
-			pf.init(sense_x, sense_y, sense_theta, sigma_pos);
-		  }
-		  else {
-			// Predict the vehicle's next state from previous (noiseless control) data.
-		  	double previous_velocity = std::stod(j[1]["previous_velocity"].get<std::string>());
-			double previous_yawrate = std::stod(j[1]["previous_yawrate"].get<std::string>());
-
-			pf.prediction(delta_t, sigma_pos, previous_velocity, previous_yawrate);
-		  }
-
-		  // receive noisy observation data from the simulator
-		  // sense_observations in JSON format [{obs_x,obs_y},{obs_x,obs_y},...{obs_x,obs_y}]
-		  	vector<LandmarkObs> noisy_observations;
-		  	string sense_observations_x = j[1]["sense_observations_x"];
-		  	string sense_observations_y = j[1]["sense_observations_y"];
-
-		  	std::vector<float> x_sense;
-  			std::istringstream iss_x(sense_observations_x);
-
-  			std::copy(std::istream_iterator<float>(iss_x),
-        	std::istream_iterator<float>(),
-        	std::back_inserter(x_sense));
-
-        	std::vector<float> y_sense;
-  			std::istringstream iss_y(sense_observations_y);
-
-  			std::copy(std::istream_iterator<float>(iss_y),
-        	std::istream_iterator<float>(),
-        	std::back_inserter(y_sense));
-
-        	for(int i = 0; i < x_sense.size(); i++)
-        	{
-        		LandmarkObs obs;
-        		obs.x = x_sense[i];
-				obs.y = y_sense[i];
-				noisy_observations.push_back(obs);
-        	}
-
-		  // Update the weights and resample
-		  pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, map);
-		  pf.resample();
-
-		  // Calculate and output the average weighted error of the particle filter over all time steps so far.
-		  vector<Particle> particles = pf.particles;
-		  int num_particles = particles.size();
-		  double highest_weight = -1.0;
-		  Particle best_particle;
-		  double weight_sum = 0.0;
-		  for (int i = 0; i < num_particles; ++i) {
-			if (particles[i].weight > highest_weight) {
-				highest_weight = particles[i].weight;
-				best_particle = particles[i];
-			}
-			weight_sum += particles[i].weight;
-		  }
-		  cout << "highest w " << highest_weight << endl;
-		  cout << "average w " << weight_sum/num_particles << endl;
-
-          json msgJson;
-          msgJson["best_particle_x"] = best_particle.x;
-          msgJson["best_particle_y"] = best_particle.y;
-          msgJson["best_particle_theta"] = best_particle.theta;
-
-          //Optional message data used for debugging particle's sensing and associations
-          msgJson["best_particle_associations"] = pf.getAssociations(best_particle);
-          msgJson["best_particle_sense_x"] = pf.getSenseX(best_particle);
-          msgJson["best_particle_sense_y"] = pf.getSenseY(best_particle);
-
-          auto msg = "42[\"best_particle\"," + msgJson.dump() + "]";
-          // std::cout << msg << std::endl;
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-	  
-        }
+    if (message == MESSAGE_TELEMETRY)
+    {
+      int session_id = telemetry.session_id;
+      auto socket = replies.sockets.find(session_id);
+      if (socket == replies.sockets.end()) {
+        replies.sockets.insert(std::make_pair(session_id, ws));
       } else {
-        std::string msg = "42[\"manual\",{}]";
-        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+        socket->second = ws;
       }
+      if (!engine.submit(telemetry)) {
+        cerr << "Session " << session_id << " busy, dropping telemetry" << endl;
+      }
+    }
+    else if (message == MESSAGE_MANUAL)
+    {
+      std::string msg = "42[\"manual\",{}]";
+      ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
     }
 
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
+  // Filter metrics are exported over HTTP, e.g. curl http://localhost:4567/metrics
+  h.onHttpRequest([&metrics,&metrics_text](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
     const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1)
+    uWS::Header url = req.getUrl();
+    if (url.valueLength == 1)
     {
       res->end(s.data(), s.length());
     }
+    else if (std::string(url.value, url.valueLength) == "/metrics")
+    {
+      metrics.format(metrics_text);
+      res->end(metrics_text.data(), metrics_text.length());
+    }
     else
     {
       // i guess this should be done more gracefully?
@@ -172,7 +184,17 @@ int main()
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+  h.onDisconnection([&h,&engine,&replies](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+    // Sessions of this socket are dropped with their filters; a vehicle sending
+    // telemetry again starts over from its next GPS fix
+    for (auto socket = replies.sockets.begin(); socket != replies.sockets.end(); ) {
+      if (socket->second == ws) {
+        engine.remove(socket->first);
+        socket = replies.sockets.erase(socket);
+      } else {
+        ++socket;
+      }
+    }
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
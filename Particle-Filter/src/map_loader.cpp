@@ -0,0 +1,243 @@
+/*
+ * map_loader.cpp
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fast_parse.h"
+#include "map_loader.h"
+
+using namespace std;
+
+/*
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+	int fd;
+	const char* data_;
+	size_t size_;
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	explicit MappedFile(const string& filename) : fd(-1), data_(nullptr), size_(0) {
+		fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			return;
+		}
+		size_ = st.st_size;
+		if (size_ > 0) {
+			void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				data_ = static_cast<const char*>(p);
+				madvise(p, size_, MADV_SEQUENTIAL);
+			}
+		}
+	}
+
+	~MappedFile() {
+		if (data_) {
+			munmap(const_cast<char*>(data_), size_);
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	// An empty file opens fine but has no mapping
+	bool ok() const { return fd >= 0 && (data_ != nullptr || size_ == 0); }
+	const char* data() const { return data_; }
+	size_t size() const { return size_; }
+};
+
+/*
+ * Header of the binary map cache, followed by the landmark array and the
+ * serialized spatial index.
+ */
+struct MapCacheHeader {
+	char magic[8];
+	uint64_t source_size;		// Size of the text map the cache was built from [bytes]
+	int64_t source_mtime;		// Its modification time [s since epoch]
+	int64_t source_mtime_ns;	// and the nanoseconds of it, as edits may fall in the same second
+	uint64_t num_landmarks;
+	double cell_size;			// Cell size requested for the spatial index
+	uint64_t index_bytes;
+	uint64_t checksum;			// Checksum of everything after the header
+};
+
+static const char kCacheMagic[8] = { 'P', 'F', 'M', 'A', 'P', 'C', '2', '\0' };
+
+// Sub-second part of a file's modification time [ns]
+static int64_t mtimeNanoseconds(const struct stat& st) {
+#ifdef __APPLE__
+	return st.st_mtimespec.tv_nsec;
+#else
+	return st.st_mtim.tv_nsec;
+#endif
+}
+
+// FNV-1a over 64-bit words, then the trailing bytes
+static uint64_t checksum(const char* data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; i++) {
+		uint64_t w;
+		memcpy(&w, data + 8 * i, 8);
+		hash = (hash ^ w) * 1099511628211ULL;
+	}
+	for (size_t i = words * 8; i < size; i++) {
+		hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readCache(const string& cache_name, const struct stat& source, double cell_size, Map& map) {
+	MappedFile cache(cache_name);
+	if (!cache.ok() || cache.size() < sizeof(MapCacheHeader)) {
+		return false;
+	}
+	MapCacheHeader header;
+	memcpy(&header, cache.data(), sizeof(header));
+	const char* payload = cache.data() + sizeof(header);
+	size_t landmark_bytes = header.num_landmarks * sizeof(Map::single_landmark_s);
+
+	if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+			header.source_size != (uint64_t)source.st_size ||
+			header.source_mtime != (int64_t)source.st_mtime ||
+			header.source_mtime_ns != mtimeNanoseconds(source) ||
+			header.cell_size != cell_size ||
+			cache.size() != sizeof(header) + landmark_bytes + header.index_bytes ||
+			header.checksum != checksum(payload, landmark_bytes + header.index_bytes)) {
+		return false;
+	}
+
+	map.landmark_list.resize(header.num_landmarks);
+	memcpy(map.landmark_list.data(), payload, landmark_bytes);
+	return map.index.deserialize(payload + landmark_bytes, header.index_bytes);
+}
+
+// Writes the cache through a temporary file so readers never see a partial cache
+static void writeCache(const string& cache_name, const struct stat& source, double cell_size, const Map& map) {
+	size_t landmark_bytes = map.landmark_list.size() * sizeof(Map::single_landmark_s);
+	size_t index_bytes = map.index.serializedSize();
+	vector<char> payload(landmark_bytes + index_bytes);
+	memcpy(payload.data(), map.landmark_list.data(), landmark_bytes);
+	map.index.serialize(payload.data() + landmark_bytes);
+
+	MapCacheHeader header;
+	memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.source_size = source.st_size;
+	header.source_mtime = source.st_mtime;
+	header.source_mtime_ns = mtimeNanoseconds(source);
+	header.num_landmarks = map.landmark_list.size();
+	header.cell_size = cell_size;
+	header.index_bytes = index_bytes;
+	header.checksum = checksum(payload.data(), payload.size());
+
+	string tmp_name = cache_name + ".tmp";
+	FILE* out = fopen(tmp_name.c_str(), "wb");
+	if (!out) {
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+			fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+	written = (fclose(out) == 0) && written;
+	if (!written || rename(tmp_name.c_str(), cache_name.c_str()) != 0) {
+		remove(tmp_name.c_str());
+	}
+}
+
+// Parses "x y id" lines straight out of the mapped text
+static void parseMap(const char* p, const char* end, Map& map) {
+	// One landmark per line, so reserve by the line count
+	size_t lines = 0;
+	for (const char* q = p; (q = static_cast<const char*>(memchr(q, '\n', end - q))) != nullptr; q++) {
+		lines++;
+	}
+	map.landmark_list.reserve(lines + 1);
+
+	while ((p = skip_separators(p, end)) < end) {
+		double x = 0, y = 0;
+		int id = 0;
+		const char* q = parse_double(p, end, x);
+		if (q == p) {
+			break;
+		}
+		q = parse_double(skip_separators(q, end), end, y);
+		q = parse_int(skip_separators(q, end), end, id);
+
+		Map::single_landmark_s landmark;
+		landmark.id_i = id;
+		landmark.x_f = (float)x;
+		landmark.y_f = (float)y;
+		map.landmark_list.push_back(landmark);
+
+		// Ignore anything else on the line
+		const char* eol = static_cast<const char*>(memchr(q, '\n', end - q));
+		p = eol ? eol + 1 : end;
+	}
+}
+
+bool read_map_data_cached(const std::string& filename, Map& map, double cell_size) {
+	struct stat source;
+	if (stat(filename.c_str(), &source) != 0) {
+		return false;
+	}
+
+	string cache_name = filename + ".cache";
+	if (readCache(cache_name, source, cell_size, map)) {
+		return true;
+	}
+
+	MappedFile text(filename);
+	if (!text.ok()) {
+		return false;
+	}
+	map.landmark_list.clear();
+	if (text.size() > 0) {
+		parseMap(text.data(), text.data() + text.size(), map);
+	}
+	map.buildIndex(cell_size);
+
+	writeCache(cache_name, source, cell_size, map);
+	return true;
+}
+
+bool read_landmark_data_fast(const std::string& filename, std::vector<LandmarkObs>& observations) {
+	MappedFile file(filename);
+	if (!file.ok()) {
+		return false;
+	}
+	observations.clear();
+	if (file.size() == 0) {
+		return true;
+	}
+
+	const char* p = file.data();
+	const char* end = p + file.size();
+	while ((p = skip_separators(p, end)) < end) {
+		LandmarkObs meas;
+		const char* q = parse_double(p, end, meas.x);
+		if (q == p) {
+			break;
+		}
+		q = parse_double(skip_separators(q, end), end, meas.y);
+		meas.id = 0;
+		observations.push_back(meas);
+
+		const char* eol = static_cast<const char*>(memchr(q, '\n', end - q));
+		p = eol ? eol + 1 : end;
+	}
+	return true;
+}
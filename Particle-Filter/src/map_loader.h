@@ -0,0 +1,33 @@
+/*
+ * map_loader.h
+ *
+ * Memory-mapped loaders for map and observation files.
+ */
+
+#ifndef MAP_LOADER_H_
+#define MAP_LOADER_H_
+
+#include <string>
+#include <vector>
+#include "helper_functions.h"
+
+/* Reads map data from a file in the map_data.txt format and builds its spatial index.
+ * A binary cache of the landmarks and index is written next to the file
+ * (filename + ".cache") on first load and used instead of parsing the text as long
+ * as the source file's size and modification time match and the checksum is intact.
+ * @param filename Name of file containing map data.
+ * @param map Map to fill, its previous landmarks are replaced
+ * @param cell_size Spatial index cell size [m], chosen from the landmark density if <= 0
+ * @output True if opening and reading file was successful
+ */
+bool read_map_data_cached(const std::string& filename, Map& map, double cell_size = 0);
+
+/* Reads landmark observation data from a file through a memory mapping.
+ * @param filename Name of file containing landmark observation measurements.
+ * @param observations Observations read, previous content is replaced but the
+ *   capacity is kept so repeated reads do not reallocate
+ * @output True if opening and reading file was successful
+ */
+bool read_landmark_data_fast(const std::string& filename, std::vector<LandmarkObs>& observations);
+
+#endif /* MAP_LOADER_H_ */
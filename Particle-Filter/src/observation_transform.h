@@ -0,0 +1,47 @@
+/*
+ * observation_transform.h
+ *
+ * Batched transform of vehicle-frame observations into the map frame of
+ * every particle.
+ */
+
+#ifndef OBSERVATION_TRANSFORM_H_
+#define OBSERVATION_TRANSFORM_H_
+
+#include <stddef.h>
+
+/**
+ * transformObservations Rotates and translates all observations by the pose of
+ *   every particle. Inputs and outputs are structure-of-arrays and the sine and
+ *   cosine of each particle's heading are computed once by the caller, so the
+ *   inner loop over observations is branch-free and vectorizes.
+ * @param p_x Particle x positions [m]
+ * @param p_y Particle y positions [m]
+ * @param cos_theta Cosine of the particle headings
+ * @param sin_theta Sine of the particle headings
+ * @param n_particles Number of particles
+ * @param obs_x Observation x coordinates in the vehicle frame [m]
+ * @param obs_y Observation y coordinates in the vehicle frame [m]
+ * @param n_observations Number of observations
+ * @param map_x Output, n_particles rows of n_observations map-frame x coordinates
+ * @param map_y Output, n_particles rows of n_observations map-frame y coordinates
+ */
+inline void transformObservations(const double* p_x, const double* p_y,
+		const double* cos_theta, const double* sin_theta, size_t n_particles,
+		const double* __restrict__ obs_x, const double* __restrict__ obs_y, size_t n_observations,
+		double* __restrict__ map_x, double* __restrict__ map_y) {
+	for (size_t i = 0; i < n_particles; i++) {
+		const double x = p_x[i];
+		const double y = p_y[i];
+		const double c = cos_theta[i];
+		const double s = sin_theta[i];
+		double* __restrict__ row_x = map_x + i * n_observations;
+		double* __restrict__ row_y = map_y + i * n_observations;
+		for (size_t j = 0; j < n_observations; j++) {
+			row_x[j] = c * obs_x[j] - s * obs_y[j] + x;
+			row_y[j] = s * obs_x[j] + c * obs_y[j] + y;
+		}
+	}
+}
+
+#endif /* OBSERVATION_TRANSFORM_H_ */
@@ -7,6 +7,7 @@
 
 #include <random>
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <numeric>
 #include <math.h>
@@ -14,7 +15,9 @@
 #include <sstream>
 #include <string>
 #include <iterator>
+#include <limits>
 
+#include "observation_transform.h"
 #include "particle_filter.h"
 
 using namespace std;
@@ -25,47 +28,48 @@ void ParticleFilter::init(double x, double y, double theta, double std[]) {
 	// Add random Gaussian noise to each particle.
 	// NOTE: Consult particle_filter.h for more information about this method (and others in this file).
 
-	//random seed
-	static default_random_engine random_gen;
+	//Start from the upper bound, KLD-sampling shrinks the set once it converges
+	num_particles = max_particles;
+	particles.reserve(max_particles);
+	new_particles.reserve(max_particles);
 
-  //Define Gaussian noise generators on GPS sensor
-  normal_distribution<double> x_Norm(0, std[0]);
-  normal_distribution<double> y_Norm(0, std[1]);
-  normal_distribution<double> theta_Norm(0, std[2]);
+	//Standard normal draws for the GPS sensor noise of all particles
+	ScratchArena& arena = ScratchArena::local();
+	ScratchArena::Scope scope(arena);
+	ScratchVector<double> noise(3 * num_particles, 0.0, ArenaAllocator<double>(arena));
+	random.gaussian(noise.data(), noise.size());
 
-	//Set to some random int
-	num_particles = 200;
 	for(int i = 0; i< num_particles; i++)
 	{
 		//initialize particles with noisy sensor data
 		Particle particle;
 		particle.id = i;
-		particle.x = x + x_Norm(random_gen);
-		particle.y = y + y_Norm(random_gen);
-		particle.theta = theta + theta_Norm(random_gen);
+		particle.x = x + std[0] * noise[3 * i];
+		particle.y = y + std[1] * noise[3 * i + 1];
+		particle.theta = theta + std[2] * noise[3 * i + 2];
 		//Set all default values of initialized particles to weight 1
 		particle.weight = 1.;
 		//add to particle list/vector of particle filter
 		particles.push_back(particle);
 	}
 
+	//the likelihood averages of recovery restart with the particle set
+	w_slow = 0.0;
+	w_fast = 0.0;
+
 	//initialized particle filter
 	is_initialized = true;
 }
 
 void ParticleFilter::prediction(double delta_t, double std_pos[], double velocity, double yaw_rate) {
 	// TODO: Add measurements to each particle and add random Gaussian noise.
-	// NOTE: When adding noise you may find std::normal_distribution and std::default_random_engine useful.
-	//  http://en.cppreference.com/w/cpp/numeric/random/normal_distribution
-	//  http://www.cplusplus.com/reference/random/default_random_engine/
-
-	//random seed
-	static default_random_engine random_gen;
+	auto start = chrono::steady_clock::now();
 
-	//Define Gaussian noise generators on GPS sensor
-  normal_distribution<double> x_Norm(0, std_pos[0]);
-  normal_distribution<double> y_Norm(0, std_pos[1]);
-  normal_distribution<double> theta_Norm(0, std_pos[2]);
+	//Standard normal draws for the motion noise of all particles, in one batch
+	ScratchArena& arena = ScratchArena::local();
+	ScratchArena::Scope scope(arena);
+	ScratchVector<double> noise(3 * num_particles, 0.0, ArenaAllocator<double>(arena));
+	random.gaussian(noise.data(), noise.size());
 
 	for (int i=0; i<num_particles; i++)
 	{
@@ -85,29 +89,30 @@ void ParticleFilter::prediction(double delta_t, double std_pos[], double velocit
 		}
 
 		//Add measurement noise
-		particles[i].x += x_Norm(random_gen);
-    particles[i].y += y_Norm(random_gen);
-    particles[i].theta += theta_Norm(random_gen);
+		particles[i].x += std_pos[0] * noise[3 * i];
+    particles[i].y += std_pos[1] * noise[3 * i + 1];
+    particles[i].theta += std_pos[2] * noise[3 * i + 2];
 	}
+
+	step_stats.prediction_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 }
 
-void ParticleFilter::dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations) {
-	// TODO: Find the predicted measurement that is closest to each observed measurement and assign the
-	//   observed measurement to this particular landmark.
-	// NOTE: this method will NOT be called by the grading code. But you will probably find it useful to
-	//   implement this method and use it as a helper during the updateWeights phase.
+// Nearest-neighbour association over raw arrays, shared by dataAssociation and the
+// scratch buffers of updateWeights
+static void associateNearest(const LandmarkObs* predicted, size_t n_predicted,
+		LandmarkObs* observations, size_t n_observations) {
 
-	for (int i = 0; i < observations.size(); i++)
+	for (size_t i = 0; i < n_observations; i++)
 	{
-    LandmarkObs observation = observations[i];
+    const LandmarkObs& observation = observations[i];
 		//magic numbers for search O(predicted.size()*observed.size())
 		//initialization
     double minDist = 1e19;
     int minParticleId = -1;
 
-    for (int j = 0; j < predicted.size(); j++)
+    for (size_t j = 0; j < n_predicted; j++)
 		{
-      LandmarkObs prediction = predicted[j];
+      const LandmarkObs& prediction = predicted[j];
 			//Helper function from Helper.h
       double Currentdistance = dist(observation.x, observation.y, prediction.x, prediction.y);
 
@@ -121,8 +126,17 @@ void ParticleFilter::dataAssociation(std::vector<LandmarkObs> predicted, std::ve
   }
 }
 
-void ParticleFilter::updateWeights(double sensor_range, double std_landmark[],
-		std::vector<LandmarkObs> observations, Map map_landmarks) {
+void ParticleFilter::dataAssociation(const std::vector<LandmarkObs>& predicted, std::vector<LandmarkObs>& observations) {
+	// TODO: Find the predicted measurement that is closest to each observed measurement and assign the
+	//   observed measurement to this particular landmark.
+	// NOTE: this method will NOT be called by the grading code. But you will probably find it useful to
+	//   implement this method and use it as a helper during the updateWeights phase.
+
+	associateNearest(predicted.data(), predicted.size(), observations.data(), observations.size());
+}
+
+void ParticleFilter::updateWeights(double sensor_range, const double std_landmark[],
+		const std::vector<LandmarkObs>& observations, const Map& map_landmarks) {
 	// TODO: Update the weights of each particle using a mult-variate Gaussian distribution. You can read
 	//   more about this distribution here: https://en.wikipedia.org/wiki/Multivariate_normal_distribution
 	// NOTE: The observations are given in the VEHICLE'S coordinate system. Your particles are located
@@ -133,67 +147,135 @@ void ParticleFilter::updateWeights(double sensor_range, double std_landmark[],
 	//   and the following is a good resource for the actual equation to implement (look at equation
 	//   3.33
 	//   http://planning.cs.uiuc.edu/node99.html
-	for (int i = 0; i < num_particles; i++)
-	{
-		// get the particle details
-		double p_x = particles[i].x;
-		double p_y = particles[i].y;
-		double p_theta = particles[i].theta;
+	auto start = chrono::steady_clock::now();
+
+	// Temporaries live in the thread's scratch arena, which reaches a steady size
+	// after the first steps
+	ScratchArena& arena = ScratchArena::local();
+	ScratchArena::Scope step_scope(arena);
+	size_t heap_allocations = arena.heapAllocations();
+	ArenaAllocator<double> scratch(arena);
+	ArenaAllocator<int> scratch_matches(arena);
+
+	//Weights calculations for observations using mult-variate Gaussian
+	double std_x = std_landmark[0];
+	double std_y = std_landmark[1];
+	double gauss_norm = 1/(2*M_PI*std_x*std_y);
+
+	// Unassociated observations are weighted as if matched at the gate distance
+	double gate_offset = association_gate / sqrt(2.0);
+
+	int best_index = -1;
+	step_stats.highest_weight = -1.0;
+	step_stats.weight_sum = 0.0;
+	double weight_square_sum = 0.0;
+
+	// Observations and particle poses as structure-of-arrays, with the heading's
+	// sine and cosine computed once per particle
+	size_t n_observations = observations.size();
+	ScratchVector<double> obs_x(n_observations, 0.0, scratch);
+	ScratchVector<double> obs_y(n_observations, 0.0, scratch);
+	for (size_t j = 0; j < n_observations; j++) {
+		obs_x[j] = observations[j].x;
+		obs_y[j] = observations[j].y;
+	}
+	ScratchVector<double> p_x(num_particles, 0.0, scratch);
+	ScratchVector<double> p_y(num_particles, 0.0, scratch);
+	ScratchVector<double> cos_theta(num_particles, 0.0, scratch);
+	ScratchVector<double> sin_theta(num_particles, 0.0, scratch);
+	for (int i = 0; i < num_particles; i++) {
+		p_x[i] = particles[i].x;
+		p_y[i] = particles[i].y;
+		cos_theta[i] = cos(particles[i].theta);
+		sin_theta[i] = sin(particles[i].theta);
+	}
 
-		//Holds all landmarks within particle range
-		vector<LandmarkObs> predictions;
+	// Transform sensor observations coordinates to map coordinates for all particles at once
+	ScratchVector<double> map_x(num_particles * n_observations, 0.0, scratch);
+	ScratchVector<double> map_y(num_particles * n_observations, 0.0, scratch);
+	transformObservations(p_x.data(), p_y.data(), cos_theta.data(), sin_theta.data(), num_particles,
+			obs_x.data(), obs_y.data(), n_observations, map_x.data(), map_y.data());
 
-		for (int j = 0; j < map_landmarks.landmark_list.size(); j++)
-		{
-			float l_x = map_landmarks.landmark_list[j].x_f;
-			float l_y = map_landmarks.landmark_list[j].y_f;
-			int l_id = map_landmarks.landmark_list[j].id_i;
+	ScratchVector<int> matches(n_observations, -1, scratch_matches);
 
-			if (abs(dist(p_x, p_y, l_x, l_y)) <= sensor_range)
-			{
-				predictions.push_back(LandmarkObs{ l_id, l_x, l_y });
+	for (int i = 0; i < num_particles; i++)
+	{
+		// This particle's row of transformed observations
+		const double* t_x = map_x.data() + i * n_observations;
+		const double* t_y = map_y.data() + i * n_observations;
+
+		if (likelihood_field) {
+			// One table lookup per observation instead of association
+			double log_weight = 0.0;
+			for (size_t j = 0; j < n_observations; j++) {
+				log_weight += likelihood_field->logLikelihood(t_x[j], t_y[j]);
 			}
+			particles[i].weight = exp(log_weight);
 		}
-		// Transform sensor observations coordinates to map and particle coordinates
-		vector<LandmarkObs> transformed_observations;
-
-		for (int j = 0; j < observations.size(); j++)
-		{
-			double t_x = cos(p_theta)*observations[j].x - sin(p_theta)*observations[j].y + p_x;
-			double t_y = sin(p_theta)*observations[j].x + cos(p_theta)*observations[j].y + p_y;
-			transformed_observations.push_back(LandmarkObs{ observations[j].id, t_x, t_y });
-		}
+		else {
+			// Associate each observation with a landmark in sensor range, given as a direct
+			// index into the map's landmark list
+			associateObservations(association_method, map_landmarks, p_x[i], p_y[i], sensor_range, association_gate,
+					t_x, t_y, n_observations, matches.data());
 
-		//Find closest predicted particles to observations
-		dataAssociation(predictions, transformed_observations);
+			// set weights to 1.0
+			particles[i].weight = 1.0;
 
-		// set weights to 1.0
-		particles[i].weight = 1.0;
-
-		for (int j = 0; j < transformed_observations.size(); j++)
-		{
-			// placeholders for observation and associated prediction coordinates
-			double o_x = transformed_observations[j].x;
-			double o_y = transformed_observations[j].y;
-			int o_id = transformed_observations[j].id;
-
-			// get the x,y coordinates of the prediction associated with the current observation
-			double pr_x, pr_y;
-			for (int k = 0; k < predictions.size(); k++)
+			for (size_t j = 0; j < n_observations; j++)
 			{
-				if (predictions[k].id == o_id) {
-					pr_x = predictions[k].x;
-					pr_y = predictions[k].y;
+				double d_x = gate_offset;
+				double d_y = gate_offset;
+				if (matches[j] >= 0) {
+					const Map::single_landmark_s& landmark = map_landmarks.landmark_list[matches[j]];
+					d_x = landmark.x_f - t_x[j];
+					d_y = landmark.y_f - t_y[j];
 				}
+				double observation_w = gauss_norm * exp( -( d_x*d_x/(2*std_x*std_x) + d_y*d_y/(2*std_y*std_y) ) );
+				// product of this obersvation weight with total observations weight
+				particles[i].weight *= observation_w;
 			}
-			//Weights calculations for observations using mult-variate Gaussian
-			double std_x = std_landmark[0];
-			double std_y = std_landmark[1];
-			double observation_w = (1/(2*M_PI*std_x*std_y)) * exp( -( pow(pr_x-o_x,2)/(2*pow(std_x, 2)) + (pow(pr_y-o_y,2)/(2*pow(std_y, 2))) ) );
-			// product of this obersvation weight with total observations weight
-			particles[i].weight *= observation_w;
 		}
+
+		// Track the best particle and the weight sum while the weights are produced
+		if (particles[i].weight > step_stats.highest_weight) {
+			step_stats.highest_weight = particles[i].weight;
+			best_index = i;
+		}
+		step_stats.weight_sum += particles[i].weight;
+		weight_square_sum += particles[i].weight * particles[i].weight;
   }
+	step_stats.effective_sample_size = weight_square_sum > 0.0 ?
+			step_stats.weight_sum * step_stats.weight_sum / weight_square_sum : 0.0;
+
+	// Slow and fast averages of the likelihood for recovery. The mean weight is a
+	// product over the observations, so it is taken per observation to keep steps
+	// with different observation counts comparable; a collapse to zero counts as 0.
+	if (recovery_max_injected > 0 && n_observations > 0 && num_particles > 0) {
+		double w_avg = step_stats.weight_sum / num_particles;
+		double likelihood = w_avg > 0.0 ? exp(log(w_avg) / n_observations) : 0.0;
+		w_slow += recovery_alpha_slow * (likelihood - w_slow);
+		w_fast += recovery_alpha_fast * (likelihood - w_fast);
+		recovery_map = &map_landmarks;
+		recovery_observations.assign(observations.begin(), observations.end());
+		recovery_sensor_range = sensor_range;
+		recovery_gate = 3.0 * max(std_x, std_y);
+	}
+
+	// Keep the best particle, resample() replaces the particle set
+	if (best_index >= 0) {
+		best_particle.id = particles[best_index].id;
+		best_particle.x = particles[best_index].x;
+		best_particle.y = particles[best_index].y;
+		best_particle.theta = particles[best_index].theta;
+		best_particle.weight = particles[best_index].weight;
+		best_particle.associations.assign(particles[best_index].associations.begin(),
+				particles[best_index].associations.end());
+		best_particle.sense_x.assign(particles[best_index].sense_x.begin(), particles[best_index].sense_x.end());
+		best_particle.sense_y.assign(particles[best_index].sense_y.begin(), particles[best_index].sense_y.end());
+	}
+
+	step_stats.scratch_allocations = arena.heapAllocations() - heap_allocations;
+	step_stats.update_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 }
 
 void ParticleFilter::resample() {
@@ -201,82 +283,255 @@ void ParticleFilter::resample() {
 	// NOTE: You may find std::discrete_distribution helpful here.
 	//   http://en.cppreference.com/w/cpp/numeric/random/discrete_distribution
 
-  //instantiate random seed
-	static default_random_engine random_gen;
+	// The number of particles drawn adapts to the spread of the posterior (KLD-sampling,
+	// Fox 2003): keep drawing until the number of samples bounds the KL-divergence
+	// between the sample set and the true posterior by kld_epsilon, given the number
+	// of histogram bins the samples occupy.
+	auto start = chrono::steady_clock::now();
 
 	//new particles buffer
-	vector<Particle> new_particles;
+	new_particles.clear();
+
+	// At most max_particles bins get occupied, so the set stays at most half full
+	size_t bin_slots = 1;
+	while (bin_slots < 2 * (size_t)max_particles) {
+		bin_slots <<= 1;
+	}
+	kld_bins.assign(bin_slots, -1);
 
    // Extract all current weights
-   vector<double> weights;
+   weights.resize(num_particles);
    for (int i = 0; i < num_particles; i++) {
-     weights.push_back(particles[i].weight);
+     weights[i] = particles[i].weight;
    }
 
    // generate random starting index for resampling wheel
-   uniform_int_distribution<int> random_int(0, num_particles-1);
-   auto index = random_int(random_gen);
+   int index = min(num_particles - 1, (int)(random.uniform() * num_particles));
 
    //get most accurate particle weight
    double max_weight = *max_element(weights.begin(), weights.end());
 
-   // uniform random distribution [0.0, max_weight]
-   uniform_real_distribution<double> random_particle_dist(0.0, max_weight);
-
    double beta = 0.0;
+   int required = min_particles;
+   int k = 0;
+
+   // recovery replaces draws while the short-term likelihood is below the long-term one
+   double inject_probability = 0.0;
+   if (recovery_max_injected > 0 && w_slow > 0.0) {
+     inject_probability = max(0.0, 1.0 - w_fast / w_slow);
+   }
+   int injected = 0;
+   Particle recovered = Particle();
 
    //resample wheel taken from Udacity classes
-   for (int i = 0; i < num_particles; i++) {
-     beta +=random_particle_dist(random_gen) * 2.0;
-     while (beta > weights[index]) {
-       beta -= weights[index];
-       index = (index + 1) % num_particles;
+   while ((int)new_particles.size() < max_particles &&
+          (int)new_particles.size() < required) {
+     if (injected < recovery_max_injected && inject_probability > 0.0 &&
+         random.uniform() < inject_probability && sampleRecoveryPose(recovered)) {
+       recovered.id = (int)new_particles.size();
+       recovered.weight = 1.0;
+       new_particles.push_back(recovered);
+       injected++;
+     }
+     else {
+       // uniform random draw in [0.0, 2 * max_weight]
+       beta += random.uniform() * max_weight * 2.0;
+       while (beta > weights[index]) {
+         beta -= weights[index];
+         index = (index + 1) % num_particles;
+       }
+       new_particles.push_back(particles[index]);
+     }
+
+     // a sample falling into an empty bin raises the required sample count
+     if (insertKldBin(kldBinKey(new_particles.back()))) {
+       k++;
+       required = max(min_particles, kldBound(k));
      }
-     new_particles.push_back(particles[index]);
    }
-   particles = new_particles;
+   particles.swap(new_particles);
+   num_particles = particles.size();
+
+   step_stats.num_particles = num_particles;
+   step_stats.kld_bins = k;
+   step_stats.injected_particles = injected;
+   step_stats.resample_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void ParticleFilter::setAssociation(AssociationMethod method, double gate) {
+	association_method = method;
+	association_gate = gate;
+}
+
+void ParticleFilter::setLikelihoodField(const LikelihoodField* field) {
+	likelihood_field = field;
+}
+
+void ParticleFilter::setRecovery(double alpha_slow, double alpha_fast, int max_injected) {
+	recovery_alpha_slow = alpha_slow;
+	recovery_alpha_fast = alpha_fast;
+	recovery_max_injected = max(0, max_injected);
 }
 
-Particle ParticleFilter::SetAssociations(Particle particle, std::vector<int> associations, std::vector<double> sense_x, std::vector<double> sense_y)
+bool ParticleFilter::sampleRecoveryPose(Particle& particle) {
+	// Draws tried per injected particle and observations checked to score a draw,
+	// which bound the cost of recovery
+	const int kTries = 4;
+	const size_t kScoredObservations = 8;
+
+	if (!recovery_map || recovery_map->index.empty() || recovery_observations.empty()) {
+		return false;
+	}
+	const vector<Map::single_landmark_s>& landmarks = recovery_map->landmark_list;
+	const vector<LandmarkObs>& observations = recovery_observations;
+	size_t n = observations.size();
+	double tolerance = 2.0 * recovery_gate;
+
+	int best_score = -1;
+	for (int t = 0; t < kTries; t++) {
+		// Landmark a explains observation i
+		size_t i = min(n - 1, (size_t)(random.uniform() * n));
+		const Map::single_landmark_s& a = landmarks[min(landmarks.size() - 1,
+				(size_t)(random.uniform() * landmarks.size()))];
+		double theta = random.uniform() * 2 * M_PI - M_PI;
+
+		// Landmark b, as far from a as observation j is from observation i, fixes the heading
+		if (n > 1) {
+			size_t j = min(n - 2, (size_t)(random.uniform() * (n - 1)));
+			j += j >= i ? 1 : 0;
+			double ox = observations[j].x - observations[i].x;
+			double oy = observations[j].y - observations[i].y;
+			double d = sqrt(ox * ox + oy * oy);
+
+			// Reservoir sample over the landmarks in the annulus around a
+			int seen = 0;
+			double bx = 0, by = 0;
+			recovery_map->index.forEachInRadius(a.x_f, a.y_f, d + tolerance, [&](int, double x, double y) {
+				double dx = x - a.x_f;
+				double dy = y - a.y_f;
+				if (dx * dx + dy * dy >= (d - tolerance) * (d - tolerance) && (dx != 0 || dy != 0)) {
+					if (random.uniform() * ++seen < 1.0) {
+						bx = x;
+						by = y;
+					}
+				}
+			});
+			if (seen > 0) {
+				theta = atan2(by - a.y_f, bx - a.x_f) - atan2(oy, ox);
+			}
+		}
+
+		double c = cos(theta);
+		double s = sin(theta);
+		double x = a.x_f - (c * observations[i].x - s * observations[i].y);
+		double y = a.y_f - (s * observations[i].x + c * observations[i].y);
+
+		// Score by how many of the observations land near a landmark
+		int score = 0;
+		size_t stride = max((size_t)1, n / kScoredObservations);
+		for (size_t m = 0; m < n; m += stride) {
+			double t_x = c * observations[m].x - s * observations[m].y + x;
+			double t_y = s * observations[m].x + c * observations[m].y + y;
+			if (recovery_map->index.nearest(t_x, t_y, recovery_gate, x, y, recovery_sensor_range) >= 0) {
+				score++;
+			}
+		}
+		if (score > best_score) {
+			best_score = score;
+			particle.x = x;
+			particle.y = y;
+			particle.theta = theta;
+		}
+	}
+	return true;
+}
+
+void ParticleFilter::setParticleBounds(int min_particles, int max_particles) {
+	this->min_particles = max(1, min_particles);
+	this->max_particles = max(this->min_particles, max_particles);
+}
+
+void ParticleFilter::setKLDParameters(double epsilon, double z, const double bin_size[]) {
+	kld_epsilon = epsilon;
+	kld_z = z;
+	for (int i = 0; i < 3; i++) {
+		kld_bin_size[i] = bin_size[i];
+	}
+}
+
+int ParticleFilter::kldBound(int k) const {
+	if (k < 2) {
+		return 1;
+	}
+	// Wilson-Hilferty approximation of the chi-square quantile with k-1 degrees of freedom
+	double a = 2.0 / (9.0 * (k - 1));
+	double b = 1.0 - a + sqrt(a) * kld_z;
+	double n = (k - 1) / (2.0 * kld_epsilon) * b * b * b;
+	return n < max_particles ? (int)ceil(n) : max_particles;
+}
+
+long long ParticleFilter::kldBinKey(const Particle& particle) const {
+	double theta = fmod(particle.theta, 2.0 * M_PI);
+	if (theta < 0) {
+		theta += 2.0 * M_PI;
+	}
+	// 21 bits per dimension
+	long long bx = (long long)floor(particle.x / kld_bin_size[0]) & 0x1FFFFF;
+	long long by = (long long)floor(particle.y / kld_bin_size[1]) & 0x1FFFFF;
+	long long bt = (long long)floor(theta / kld_bin_size[2]) & 0x1FFFFF;
+	return (bx << 42) | (by << 21) | bt;
+}
+
+bool ParticleFilter::insertKldBin(long long key) {
+	size_t mask = kld_bins.size() - 1;
+	// Mix the packed bin coordinates so neighbouring bins spread over the table
+	unsigned long long hash = (unsigned long long)key * 0x9E3779B97F4A7C15ULL;
+	size_t slot = (size_t)(hash ^ (hash >> 32)) & mask;
+	while (kld_bins[slot] != -1) {
+		if (kld_bins[slot] == key) {
+			return false;
+		}
+		slot = (slot + 1) & mask;
+	}
+	kld_bins[slot] = key;
+	return true;
+}
+
+void ParticleFilter::SetAssociations(Particle& particle, const std::vector<int>& associations,
+		const std::vector<double>& sense_x, const std::vector<double>& sense_y)
 {
 	//particle: the particle to assign each listed association, and association's (x,y) world coordinates mapping to
 	// associations: The landmark id that goes along with each listed association
 	// sense_x: the associations x mapping already converted to world coordinates
 	// sense_y: the associations y mapping already converted to world coordinates
 
-	//Clear the previous associations
-	particle.associations.clear();
-	particle.sense_x.clear();
-	particle.sense_y.clear();
-
-	particle.associations= associations;
- 	particle.sense_x = sense_x;
- 	particle.sense_y = sense_y;
-
- 	return particle;
+	//Replace the previous associations, assign() reuses the existing capacity
+	particle.associations.assign(associations.begin(), associations.end());
+ 	particle.sense_x.assign(sense_x.begin(), sense_x.end());
+ 	particle.sense_y.assign(sense_y.begin(), sense_y.end());
 }
 
-string ParticleFilter::getAssociations(Particle best)
+string ParticleFilter::getAssociations(const Particle& best) const
 {
-	vector<int> v = best.associations;
+	const vector<int>& v = best.associations;
 	stringstream ss;
     copy( v.begin(), v.end(), ostream_iterator<int>(ss, " "));
     string s = ss.str();
     s = s.substr(0, s.length()-1);  // get rid of the trailing space
     return s;
 }
-string ParticleFilter::getSenseX(Particle best)
+string ParticleFilter::getSenseX(const Particle& best) const
 {
-	vector<double> v = best.sense_x;
+	const vector<double>& v = best.sense_x;
 	stringstream ss;
     copy( v.begin(), v.end(), ostream_iterator<float>(ss, " "));
     string s = ss.str();
     s = s.substr(0, s.length()-1);  // get rid of the trailing space
     return s;
 }
-string ParticleFilter::getSenseY(Particle best)
+string ParticleFilter::getSenseY(const Particle& best) const
 {
-	vector<double> v = best.sense_y;
+	const vector<double>& v = best.sense_y;
 	stringstream ss;
     copy( v.begin(), v.end(), ostream_iterator<float>(ss, " "));
     string s = ss.str();
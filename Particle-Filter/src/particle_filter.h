@@ -9,7 +9,12 @@
 #ifndef PARTICLE_FILTER_H_
 #define PARTICLE_FILTER_H_
 
+#include <limits>
 #include "helper_functions.h"
+#include "data_association.h"
+#include "filter_random.h"
+#include "likelihood_field.h"
+#include "scratch_arena.h"
 
 struct Particle {
 
@@ -23,6 +28,23 @@ struct Particle {
 	std::vector<double> sense_y;
 };
 
+/*
+ * Struct holding instrumentation collected over one filter step.
+ */
+struct FilterStepStats {
+
+	int num_particles;	// Particle count after resampling
+	int kld_bins;		// Number of occupied KLD histogram bins
+	double update_ms;	// Wall time spent in updateWeights [ms]
+	size_t scratch_allocations;	// Heap allocations made by the scratch arena in updateWeights
+	double highest_weight;	// Highest particle weight computed by updateWeights
+	double weight_sum;		// Sum of the particle weights computed by updateWeights
+	double effective_sample_size;	// (sum w)^2 / sum w^2 of the weights computed by updateWeights
+	double resample_ms;	// Wall time spent in resample [ms]
+	double prediction_ms;	// Wall time spent in prediction [ms]
+	int injected_particles;	// Particles injected by recovery in resample
+};
+
 class ParticleFilter {
 
 	// Number of particles to draw
@@ -34,14 +56,99 @@ class ParticleFilter {
 	// Vector of weights of all particles
 	std::vector<double> weights;
 
+	// Random stream for initialization, prediction noise and resampling, owned
+	// per filter so independent filters can run on separate threads
+	FilterRandom random;
+
+	// Bounds on the particle count adapted by KLD-sampling
+	int min_particles;
+	int max_particles;
+
+	// KLD-sampling parameters: error bound epsilon and upper (1 - delta)
+	// quantile of the standard normal distribution
+	double kld_epsilon;
+	double kld_z;
+
+	// KLD histogram bin size in x [m], y [m] and theta [rad]
+	double kld_bin_size[3];
+
+	// Observation to landmark association used by updateWeights and its gate [m]
+	AssociationMethod association_method;
+	double association_gate;
+
+	// Precomputed likelihood field weighting replaces association when set
+	const LikelihoodField* likelihood_field;
+
+	// Augmented MCL recovery: smoothing factors of the slow and fast averages of
+	// the per-observation likelihood, the averages, and the injection cap per step
+	double recovery_alpha_slow;
+	double recovery_alpha_fast;
+	double w_slow;
+	double w_fast;
+	int recovery_max_injected;
+
+	// Inputs of the last updateWeights call, kept for drawing recovery particles
+	const Map* recovery_map;
+	std::vector<LandmarkObs> recovery_observations;
+	double recovery_sensor_range;
+	double recovery_gate;
+
+	// Histogram bins occupied while resampling, an open-addressing set with -1 in
+	// the empty slots (reused between steps, so inserting never allocates)
+	std::vector<long long> kld_bins;
+
+	// Buffer the resampled particles are drawn into (reused between steps)
+	std::vector<Particle> new_particles;
+
+	// Instrumentation of the last filter step
+	FilterStepStats step_stats;
+
+	// Highest weighted particle of the last updateWeights call
+	Particle best_particle;
+
+	/**
+	 * kldBound Number of particles required so that the KL-divergence between
+	 *   the sample-based and true posterior stays below kld_epsilon.
+	 * @param k Number of occupied histogram bins
+	 */
+	int kldBound(int k) const;
+
+	/**
+	 * kldBinKey Histogram bin a particle falls into.
+	 */
+	long long kldBinKey(const Particle& particle) const;
+
+	/**
+	 * insertKldBin Adds a bin key to kld_bins.
+	 * @output True if the bin was not occupied yet
+	 */
+	bool insertKldBin(long long key);
+
+	/**
+	 * sampleRecoveryPose Draws a pose that explains the last observations: a pair of
+	 *   observations is matched to a pair of map landmarks the same distance apart,
+	 *   found through the spatial index, and the best scoring of a few such draws
+	 *   is kept.
+	 * @param particle Receives the pose
+	 * @output False if there is no map or no observation to sample from
+	 */
+	bool sampleRecoveryPose(Particle& particle);
+
 public:
 
 	// Set of current particles
 	std::vector<Particle> particles;
 
 	// Constructor
-	// @param M Number of particles
-	ParticleFilter() : num_particles(0), is_initialized(false) {}
+	// @param seed Seed of the filter's random stream
+	// @param stream Stream to draw from, filters sharing a seed stay independent
+	explicit ParticleFilter(uint64_t seed = 1, uint64_t stream = 0) :
+		num_particles(0), is_initialized(false), random(seed, stream),
+		min_particles(50), max_particles(500), kld_epsilon(0.05), kld_z(2.326),
+		kld_bin_size{1.0, 1.0, 0.1}, association_method(ASSOCIATION_NEAREST),
+		association_gate(std::numeric_limits<double>::infinity()), likelihood_field(nullptr),
+		recovery_alpha_slow(0.001), recovery_alpha_fast(0.1), w_slow(0), w_fast(0), recovery_max_injected(0),
+		recovery_map(nullptr), recovery_sensor_range(0), recovery_gate(0), step_stats(), best_particle() {}
 
 	// Destructor
 	~ParticleFilter() {}
@@ -74,7 +181,7 @@ public:
 	 * @param predicted Vector of predicted landmark observations
 	 * @param observations Vector of landmark observations
 	 */
-	void dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations);
+	void dataAssociation(const std::vector<LandmarkObs>& predicted, std::vector<LandmarkObs>& observations);
 
 	/**
 	 * updateWeights Updates the weights for each particle based on the likelihood of the
@@ -85,8 +192,8 @@ public:
 	 * @param observations Vector of landmark observations
 	 * @param map Map class containing map landmarks
 	 */
-	void updateWeights(double sensor_range, double std_landmark[], std::vector<LandmarkObs> observations,
-			Map map_landmarks);
+	void updateWeights(double sensor_range, const double std_landmark[], const std::vector<LandmarkObs>& observations,
+			const Map& map_landmarks);
 
 	/**
 	 * resample Resamples from the updated set of particles to form
@@ -94,15 +201,63 @@ public:
 	 */
 	void resample();
 
+	/**
+	 * setAssociation Selects how updateWeights associates observations with landmarks.
+	 *   Nearest neighbour uses the map's spatial index when it has been built.
+	 * @param method Nearest neighbour or globally optimal assignment
+	 * @param gate Observations farther than gate [m] from every landmark stay unassociated
+	 */
+	void setAssociation(AssociationMethod method, double gate);
+
+	/**
+	 * setLikelihoodField Weights particles by looking their transformed observations up
+	 *   in a precomputed likelihood field instead of associating them with landmarks.
+	 *   The field's landmark uncertainty and miss distance then take the place of
+	 *   std_landmark and the association gate, and it ignores the sensor range.
+	 * @param field Field built from the map passed to updateWeights, which must outlive
+	 *   its use here, or nullptr to weight by association again
+	 */
+	void setLikelihoodField(const LikelihoodField* field);
+
+	/**
+	 * setRecovery Enables augmented MCL recovery from divergence (Thrun et al., Probabilistic
+	 *   Robotics, 8.3.5). updateWeights tracks a slow and a fast exponential average of the
+	 *   per-observation likelihood; while the fast one drops below the slow one, resample
+	 *   replaces each draw with probability 1 - w_fast / w_slow by a particle placed where the
+	 *   current observations match the map.
+	 * @param alpha_slow Smoothing factor of the long-term average, 0 < alpha_slow << alpha_fast
+	 * @param alpha_fast Smoothing factor of the short-term average
+	 * @param max_injected Upper bound on injected particles per step, 0 disables recovery
+	 */
+	void setRecovery(double alpha_slow, double alpha_fast, int max_injected);
+
+	/**
+	 * setParticleBounds Sets the bounds KLD-sampling adapts the particle count in.
+	 *   init draws max_particles, each resample draws between min and max.
+	 * @param min_particles Lower bound on the particle count
+	 * @param max_particles Upper bound on the particle count
+	 */
+	void setParticleBounds(int min_particles, int max_particles);
+
+	/**
+	 * setKLDParameters Sets the KLD-sampling error bound and histogram resolution.
+	 * @param epsilon Bound on the KL-divergence between sample and true posterior
+	 * @param z Upper (1 - delta) quantile of the standard normal distribution
+	 * @param bin_size[] Array of dimension 3 [bin size in x [m], y [m], theta [rad]]
+	 */
+	void setKLDParameters(double epsilon, double z, const double bin_size[]);
+
 	/*
 	 * Set a particles list of associations, along with the associations calculated world x,y coordinates
 	 * This can be a very useful debugging tool to make sure transformations are correct and assocations correctly connected
+	 * The particle is updated in place, reusing the capacity of its association vectors.
 	 */
-	Particle SetAssociations(Particle particle, std::vector<int> associations, std::vector<double> sense_x, std::vector<double> sense_y);
+	void SetAssociations(Particle& particle, const std::vector<int>& associations, const std::vector<double>& sense_x,
+			const std::vector<double>& sense_y);
 
-	std::string getAssociations(Particle best);
-	std::string getSenseX(Particle best);
-	std::string getSenseY(Particle best);
+	std::string getAssociations(const Particle& best) const;
+	std::string getSenseX(const Particle& best) const;
+	std::string getSenseY(const Particle& best) const;
 
 	/**
 	 * initialized Returns whether particle filter is initialized yet or not.
@@ -110,6 +265,21 @@ public:
 	const bool initialized() const {
 		return is_initialized;
 	}
+
+	/**
+	 * bestParticle Returns the particle with the highest weight found by the last
+	 *   updateWeights call. It stays valid across resample().
+	 */
+	const Particle& bestParticle() const {
+		return best_particle;
+	}
+
+	/**
+	 * stepStats Returns particle count and timings of the last filter step.
+	 */
+	const FilterStepStats& stepStats() const {
+		return step_stats;
+	}
 };
 
 
@@ -0,0 +1,354 @@
+/*
+ * replay.cpp
+ *
+ * Drives the particle filter from recorded control, observation and ground
+ * truth files instead of the simulator, so accuracy and run time can be
+ * checked offline. Expects the data directory layout
+ *
+ *   map_data.txt
+ *   control_data.txt
+ *   gt_data.txt
+ *   observation/observations_000001.txt ...
+ *
+ * Usage: pf_replay <data_dir> [--seeds N] [--threads T] [--tile-size S] [--resident-tiles K]
+ *                  [--likelihood-field R] [--recovery] [--kidnap STEP] [--metrics FILE] [--verbose]
+ *
+ * With --tile-size the map is written to a tile file next to map_data.txt and
+ * every replay localizes against a TiledMap keeping at most K tiles resident.
+ * With --likelihood-field the particles are weighted by a likelihood field of
+ * resolution R [m] built from the map instead of by landmark association.
+ * --recovery enables augmented MCL recovery. --kidnap moves every particle
+ * kidnap_offset away at step STEP, as after a diverged GPS fix, and reports how
+ * many steps the filter takes to get back within max_translation_error.
+ * With --metrics the replay of the first seed exports its filter metrics to
+ * FILE every metrics_interval steps.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "filter_metrics.h"
+#include "likelihood_field.h"
+#include "map_loader.h"
+#include "particle_filter.h"
+#include "tiled_map.h"
+
+using namespace std;
+
+// Recorded run shared read-only by all replays
+struct ReplayData {
+	Map map;
+	vector<control_s> controls;
+	vector<ground_truth> gt;
+	vector<vector<LandmarkObs> > observations;
+
+	// Tile file to localize against instead of the flat map, if not empty
+	string tile_file;
+	size_t resident_tiles;
+
+	// Likelihood field to weight the particles with, if built
+	LikelihoodField likelihood_field;
+
+	// Recovery from divergence, and the step the particles are displaced at (0 for never)
+	bool recovery;
+	size_t kidnap_step;
+
+	// File the first seed exports its metrics to, if not empty
+	string metrics_file;
+};
+
+// Outcome of replaying the data with one seed
+struct ReplayResult {
+	unsigned int seed;
+	double mean_error[3];	// Mean absolute x [m], y [m] and yaw [rad] error
+	double max_error[3];
+	double mean_step_ms;
+	double p99_step_ms;
+	double mean_particles;
+	double mean_active_landmarks;	// Landmarks in the tiled map's active map, 0 without tiles
+	long recovery_steps;	// Steps from the kidnapping back to max_translation_error, -1 if never
+	size_t scratch_allocations;	// Heap allocations of the scratch arena in updateWeights
+	size_t last_allocation_step;	// Last step whose updateWeights allocated, 0 for none
+	bool passed;
+};
+
+//Set up parameters here
+static const double delta_t = 0.1; // Time elapsed between measurements [sec]
+static const double sensor_range = 50; // Sensor range [m]
+static double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+static const double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
+
+// Accuracy the mean error of a replay has to stay within
+static const double max_translation_error = 1.0; // Max allowable translation error to pass [m]
+static const double max_yaw_error = 0.05; // Max allowable yaw error [rad]
+
+// Distance beyond which the likelihood field counts an observation as a miss [m]
+static const double likelihood_field_max_distance = 5.0;
+
+// Displacement of the particles when kidnapped [m]
+static const double kidnap_offset[2] = { 30.0, -20.0 };
+
+// Recovery smoothing factors and injected particles per step
+static const double recovery_alpha_slow = 0.001;
+static const double recovery_alpha_fast = 0.1;
+static const int recovery_max_injected = 10;
+
+// Steps between two metrics exports
+static const size_t metrics_interval = 100;
+
+static bool loadReplayData(const string& dir, ReplayData& data) {
+	if (!read_map_data_cached(dir + "/map_data.txt", data.map)) {
+		cerr << "Error: Could not open map file" << endl;
+		return false;
+	}
+
+	if (!read_control_data(dir + "/control_data.txt", data.controls)) {
+		cerr << "Error: Could not open control data file" << endl;
+		return false;
+	}
+	if (!read_gt_data(dir + "/gt_data.txt", data.gt)) {
+		cerr << "Error: Could not open ground truth data file" << endl;
+		return false;
+	}
+
+	data.observations.resize(data.gt.size());
+	for (size_t i = 0; i < data.gt.size(); i++) {
+		char file[64];
+		snprintf(file, sizeof(file), "/observation/observations_%06d.txt", (int)i + 1);
+		if (!read_landmark_data_fast(dir + file, data.observations[i])) {
+			cerr << "Error: Could not open observation file " << i + 1 << endl;
+			return false;
+		}
+	}
+	return !data.gt.empty();
+}
+
+static ReplayResult replay(const ReplayData& data, unsigned int seed, bool verbose) {
+	ParticleFilter pf(seed);
+	if (!data.likelihood_field.empty()) {
+		pf.setLikelihoodField(&data.likelihood_field);
+	}
+	if (data.recovery) {
+		pf.setRecovery(recovery_alpha_slow, recovery_alpha_fast, recovery_max_injected);
+	}
+	ReplayResult result = ReplayResult();
+	result.seed = seed;
+	result.recovery_steps = -1;
+
+	size_t num_steps = min(data.gt.size(), data.controls.size() + 1);
+	vector<double> step_ms(num_steps);
+	double total_particles = 0;
+	double total_active_landmarks = 0;
+
+	TiledMap tiled_map;
+	bool tiled = !data.tile_file.empty() && tiled_map.open(data.tile_file, data.resident_tiles);
+	const Map& map = tiled ? tiled_map.activeMap() : data.map;
+
+	bool export_metrics = !data.metrics_file.empty() && seed == 1;
+	FilterMetrics metrics;
+
+	for (size_t i = 0; i < num_steps; i++) {
+		auto start = chrono::steady_clock::now();
+
+		if (!pf.initialized()) {
+			// Initialize around the first ground truth position, as the simulator's noisy GPS fix
+			pf.init(data.gt[i].x, data.gt[i].y, data.gt[i].theta, sigma_pos);
+		}
+		else {
+			// Predict the vehicle's next state from previous (noiseless control) data.
+			pf.prediction(delta_t, sigma_pos, data.controls[i - 1].velocity, data.controls[i - 1].yawrate);
+		}
+		if (i > 0 && i == data.kidnap_step) {
+			for (size_t k = 0; k < pf.particles.size(); k++) {
+				pf.particles[k].x += kidnap_offset[0];
+				pf.particles[k].y += kidnap_offset[1];
+			}
+		}
+		if (tiled) {
+			tiled_map.update(pf.particles, sensor_range);
+			total_active_landmarks += tiled_map.cacheStats().active_landmarks;
+		}
+		pf.updateWeights(sensor_range, sigma_landmark, data.observations[i], map);
+		if (pf.stepStats().scratch_allocations > 0) {
+			result.scratch_allocations += pf.stepStats().scratch_allocations;
+			result.last_allocation_step = i + 1;
+		}
+		pf.resample();
+
+		// Best particle by weight, as reported to the simulator
+		const Particle& best = pf.bestParticle();
+		step_ms[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		double error[3];
+		getError(data.gt[i].x, data.gt[i].y, data.gt[i].theta,
+				best.x, best.y, best.theta, error);
+		for (int k = 0; k < 3; k++) {
+			result.mean_error[k] += error[k];
+			result.max_error[k] = max(result.max_error[k], error[k]);
+		}
+		total_particles += pf.particles.size();
+		if (data.kidnap_step > 0 && i >= data.kidnap_step && result.recovery_steps < 0 &&
+				error[0] < max_translation_error && error[1] < max_translation_error) {
+			result.recovery_steps = (long)(i - data.kidnap_step);
+		}
+
+		if (export_metrics) {
+			metrics.record(pf.stepStats(), error);
+			if ((i + 1) % metrics_interval == 0 || i + 1 == num_steps) {
+				if (!metrics.writeFile(data.metrics_file)) {
+					cerr << "Error: Could not write metrics file" << endl;
+					export_metrics = false;
+				}
+			}
+		}
+
+		if (verbose) {
+			printf("seed %u step %zu error %.3f %.3f %.4f particles %zu update ms %.3f resample ms %.3f step ms %.3f "
+					"scratch allocations %zu\n",
+					seed, i + 1, error[0], error[1], error[2], pf.particles.size(),
+					pf.stepStats().update_ms, pf.stepStats().resample_ms, step_ms[i],
+					pf.stepStats().scratch_allocations);
+			if (pf.stepStats().injected_particles > 0) {
+				printf("seed %u step %zu injected %d particles\n", seed, i + 1, pf.stepStats().injected_particles);
+			}
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		result.mean_error[k] /= num_steps;
+	}
+	result.mean_particles = total_particles / num_steps;
+	result.mean_active_landmarks = total_active_landmarks / num_steps;
+
+	double total_ms = 0;
+	for (size_t i = 0; i < num_steps; i++) {
+		total_ms += step_ms[i];
+	}
+	result.mean_step_ms = total_ms / num_steps;
+	sort(step_ms.begin(), step_ms.end());
+	result.p99_step_ms = step_ms[min(num_steps - 1, (size_t)(0.99 * num_steps))];
+
+	result.passed = result.mean_error[0] <= max_translation_error &&
+			result.mean_error[1] <= max_translation_error &&
+			result.mean_error[2] <= max_yaw_error;
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		cerr << "Usage: " << argv[0] << " <data_dir> [--seeds N] [--threads T] [--tile-size S]"
+				" [--resident-tiles K] [--likelihood-field R] [--recovery] [--kidnap STEP] [--metrics FILE]"
+				" [--verbose]" << endl;
+		return -1;
+	}
+
+	string dir = argv[1];
+	int num_seeds = 1;
+	int num_threads = max(1u, thread::hardware_concurrency());
+	bool verbose = false;
+	double tile_size = 0;
+	int resident_tiles = 16;
+	string metrics_file;
+	double field_resolution = 0;
+	bool recovery = false;
+	size_t kidnap_step = 0;
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--seeds" && i + 1 < argc) {
+			num_seeds = max(1, atoi(argv[++i]));
+		} else if (arg == "--threads" && i + 1 < argc) {
+			num_threads = max(1, atoi(argv[++i]));
+		} else if (arg == "--tile-size" && i + 1 < argc) {
+			tile_size = atof(argv[++i]);
+		} else if (arg == "--resident-tiles" && i + 1 < argc) {
+			resident_tiles = max(1, atoi(argv[++i]));
+		} else if (arg == "--likelihood-field" && i + 1 < argc) {
+			field_resolution = atof(argv[++i]);
+		} else if (arg == "--recovery") {
+			recovery = true;
+		} else if (arg == "--kidnap" && i + 1 < argc) {
+			kidnap_step = (size_t)max(0, atoi(argv[++i]));
+		} else if (arg == "--metrics" && i + 1 < argc) {
+			metrics_file = argv[++i];
+		} else if (arg == "--verbose") {
+			verbose = true;
+		} else {
+			cerr << "Unknown argument " << arg << endl;
+			return -1;
+		}
+	}
+
+	ReplayData data;
+	if (!loadReplayData(dir, data)) {
+		return -1;
+	}
+	data.metrics_file = metrics_file;
+	data.recovery = recovery;
+	data.kidnap_step = kidnap_step;
+	if (field_resolution > 0) {
+		if (!data.likelihood_field.build(data.map, field_resolution, sigma_landmark, likelihood_field_max_distance)) {
+			cerr << "Error: Could not build likelihood field" << endl;
+			return -1;
+		}
+		printf("likelihood field %.2f m, %.1f MB\n", field_resolution, data.likelihood_field.memoryBytes() / 1048576.0);
+	}
+	if (tile_size > 0) {
+		data.tile_file = dir + "/map_data.txt.tiles";
+		data.resident_tiles = resident_tiles;
+		if (!write_tiled_map(data.map, tile_size, data.tile_file)) {
+			cerr << "Error: Could not write tile file" << endl;
+			return -1;
+		}
+	}
+
+	// Seeds are handed out to the worker threads one at a time
+	vector<ReplayResult> results(num_seeds);
+	atomic<int> next_seed(0);
+	auto worker = [&]() {
+		for (int s = next_seed++; s < num_seeds; s = next_seed++) {
+			results[s] = replay(data, (unsigned int)s + 1, verbose && num_seeds == 1);
+		}
+	};
+
+	auto start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int t = 0; t < min(num_threads, num_seeds); t++) {
+		threads.push_back(thread(worker));
+	}
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+	double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	int failed = 0;
+	for (size_t s = 0; s < results.size(); s++) {
+		const ReplayResult& r = results[s];
+		printf("seed %u error x %.3f y %.3f yaw %.4f max x %.3f y %.3f yaw %.4f "
+				"step ms mean %.3f p99 %.3f particles %.1f active landmarks %.1f %s\n",
+				r.seed, r.mean_error[0], r.mean_error[1], r.mean_error[2],
+				r.max_error[0], r.max_error[1], r.max_error[2],
+				r.mean_step_ms, r.p99_step_ms, r.mean_particles, r.mean_active_landmarks,
+				r.passed ? "passed" : "FAILED");
+		printf("seed %u scratch allocations %zu, last at step %zu\n", r.seed, r.scratch_allocations,
+				r.last_allocation_step);
+		if (kidnap_step > 0) {
+			if (r.recovery_steps < 0) {
+				printf("seed %u did not recover after kidnapping\n", r.seed);
+			} else {
+				printf("seed %u recovered %ld steps after kidnapping\n", r.seed, r.recovery_steps);
+			}
+		}
+		failed += r.passed ? 0 : 1;
+	}
+	printf("%d/%d seeds passed, %zu steps each, %.2f s wall\n",
+			num_seeds - failed, num_seeds, data.gt.size(), wall);
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+/*
+ * scratch_arena.cpp
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scratch_arena.h"
+
+using namespace std;
+
+ScratchArena::~ScratchArena() {
+	rewind(0, nullptr);
+	free(block);
+}
+
+void* ScratchArena::allocate(size_t bytes, size_t align) {
+	size_t offset = (used + align - 1) & ~(align - 1);
+	if (offset + bytes <= capacity) {
+		used = offset + bytes;
+		peak = max(peak, used + overflow_bytes);
+		return block + offset;
+	}
+
+	// Block exhausted: serve the request from a dedicated chunk
+	size_t size = sizeof(Chunk) + bytes + align;
+	Chunk* chunk = static_cast<Chunk*>(malloc(size));
+	heap_allocations++;
+	chunk->next = overflow;
+	chunk->size = size;
+	overflow = chunk;
+	overflow_bytes += bytes + align;
+	peak = max(peak, used + overflow_bytes);
+
+	uintptr_t data = reinterpret_cast<uintptr_t>(chunk + 1);
+	data = (data + align - 1) & ~(uintptr_t)(align - 1);
+	return reinterpret_cast<void*>(data);
+}
+
+void ScratchArena::rewind(size_t mark, Chunk* chunk) {
+	while (overflow != chunk) {
+		Chunk* next = overflow->next;
+		overflow_bytes -= overflow->size - sizeof(Chunk);
+		free(overflow);
+		overflow = next;
+	}
+	used = mark;
+
+	// Once the arena is empty, grow the block so the peak fits without overflow
+	if (used == 0 && overflow == nullptr && peak > capacity) {
+		size_t new_capacity = max(capacity, (size_t)4096);
+		while (new_capacity < peak) {
+			new_capacity *= 2;
+		}
+		free(block);
+		block = static_cast<char*>(malloc(new_capacity));
+		heap_allocations++;
+		capacity = new_capacity;
+	}
+}
+
+ScratchArena& ScratchArena::local() {
+	static thread_local ScratchArena arena;
+	return arena;
+}
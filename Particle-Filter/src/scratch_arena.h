@@ -0,0 +1,129 @@
+/*
+ * scratch_arena.h
+ *
+ * Per-thread bump allocator for short-lived temporaries.
+ */
+
+#ifndef SCRATCH_ARENA_H_
+#define SCRATCH_ARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bump allocator handing out memory from one contiguous block. Memory is
+ * released all at once by rewinding a Scope. Allocations that do not fit go to
+ * overflow chunks, and the block is regrown to the observed peak once the
+ * arena is empty again, so after a few warm-up steps a repeated workload is
+ * served without touching the heap.
+ */
+class ScratchArena {
+
+	// Header of an overflow chunk allocated when the block is exhausted
+	struct Chunk {
+		Chunk* next;
+		size_t size;
+	};
+
+	char* block;
+	size_t capacity;
+	size_t used;
+
+	// Overflow chunks, most recent first, and the bytes they hold
+	Chunk* overflow;
+	size_t overflow_bytes;
+
+	// Highest number of bytes in use since the block was last grown
+	size_t peak;
+
+	// Number of calls into the heap made by this arena
+	size_t heap_allocations;
+
+	void rewind(size_t mark, Chunk* chunk);
+
+	ScratchArena(const ScratchArena&);
+	ScratchArena& operator=(const ScratchArena&);
+
+public:
+
+	/*
+	 * Releases everything allocated from the arena after its construction
+	 * when it goes out of scope.
+	 */
+	class Scope {
+		ScratchArena& arena;
+		size_t mark;
+		Chunk* chunk;
+
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+
+	public:
+		explicit Scope(ScratchArena& arena) : arena(arena), mark(arena.used), chunk(arena.overflow) {}
+		~Scope() { arena.rewind(mark, chunk); }
+	};
+
+	ScratchArena() : block(nullptr), capacity(0), used(0), overflow(nullptr), overflow_bytes(0),
+		peak(0), heap_allocations(0) {}
+
+	~ScratchArena();
+
+	/**
+	 * allocate Returns uninitialized memory valid until the enclosing Scope ends.
+	 * @param bytes Number of bytes requested
+	 * @param align Alignment of the returned pointer, a power of two
+	 */
+	void* allocate(size_t bytes, size_t align);
+
+	/**
+	 * heapAllocations Number of heap allocations the arena made so far. It stops
+	 *   increasing once the arena has grown to the steady-state working set.
+	 */
+	size_t heapAllocations() const {
+		return heap_allocations;
+	}
+
+	/**
+	 * local Returns the arena of the calling thread.
+	 */
+	static ScratchArena& local();
+};
+
+/*
+ * Standard allocator drawing from a ScratchArena. Deallocation is a no-op, the
+ * memory is reclaimed when the arena Scope ends.
+ */
+template <typename T>
+struct ArenaAllocator {
+
+	typedef T value_type;
+
+	ScratchArena* arena;
+
+	explicit ArenaAllocator(ScratchArena& arena) : arena(&arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, size_t) {}
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.arena != b.arena;
+}
+
+// Vector whose storage lives in a ScratchArena
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif /* SCRATCH_ARENA_H_ */
@@ -0,0 +1,231 @@
+/*
+ * telemetry_parser.cpp
+ */
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include "fast_parse.h"
+#include "telemetry_parser.h"
+
+using namespace std;
+
+static const char* skipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
+}
+
+// Scans a JSON string starting at its opening quote. [begin, stop) receives the
+// raw content; escapes are skipped over, none of the decoded fields use them.
+static const char* scanString(const char* p, const char* end, const char*& begin, const char*& stop) {
+	if (p >= end || *p != '"') {
+		return nullptr;
+	}
+	begin = ++p;
+	while (p < end && *p != '"') {
+		p += (*p == '\\') ? 2 : 1;
+	}
+	if (p >= end) {
+		return nullptr;
+	}
+	stop = p;
+	return p + 1;
+}
+
+// Skips any JSON value, nested arrays and objects included
+static const char* skipValue(const char* p, const char* end) {
+	const char* begin;
+	const char* stop;
+	if (p < end && *p == '"') {
+		return scanString(p, end, begin, stop);
+	}
+	int depth = 0;
+	while (p < end) {
+		char c = *p;
+		if (c == '"') {
+			p = scanString(p, end, begin, stop);
+			if (!p) {
+				return nullptr;
+			}
+			continue;
+		}
+		if (c == '{' || c == '[') {
+			depth++;
+		} else if (c == '}' || c == ']') {
+			if (depth == 0) {
+				return p;
+			}
+			depth--;
+		} else if (c == ',' && depth == 0) {
+			return p;
+		}
+		p++;
+	}
+	return depth == 0 ? p : nullptr;
+}
+
+static bool keyIs(const char* begin, const char* stop, const char* key) {
+	size_t n = strlen(key);
+	return (size_t)(stop - begin) == n && memcmp(begin, key, n) == 0;
+}
+
+// Reads a number given either as a JSON number or as a string holding one.
+// parsed is set if a number was found; value is left alone otherwise.
+static const char* readNumber(const char* p, const char* end, double& value, bool& parsed) {
+	if (p < end && *p == '"') {
+		const char* begin;
+		const char* stop;
+		const char* next = scanString(p, end, begin, stop);
+		if (!next) {
+			return nullptr;
+		}
+		const char* number = skip_separators(begin, stop);
+		parsed = parse_double(number, stop, value) != number;
+		return next;
+	}
+	const char* next = parse_double(p, end, value);
+	parsed = next != p;
+	return parsed ? next : skipValue(p, end);
+}
+
+// Reads a space separated list of numbers held in a string into one coordinate
+// of the observation buffer
+static const char* readObservations(const char* p, const char* end, vector<LandmarkObs>& observations,
+		size_t& count, bool x_coordinate) {
+	const char* begin;
+	const char* stop;
+	const char* next = scanString(p, end, begin, stop);
+	if (!next) {
+		return skipValue(p, end);
+	}
+	count = 0;
+	for (const char* q = skip_separators(begin, stop); q < stop; q = skip_separators(q, stop)) {
+		double value;
+		const char* after = parse_double(q, stop, value);
+		if (after == q) {
+			break;
+		}
+		if (count == observations.size()) {
+			observations.push_back(LandmarkObs{ 0, 0, 0 });
+		}
+		if (x_coordinate) {
+			observations[count].x = value;
+		} else {
+			observations[count].y = value;
+		}
+		count++;
+		q = after;
+	}
+	return next;
+}
+
+TelemetryMessage parse_telemetry(const char* data, size_t length, Telemetry& telemetry) {
+	const char* end = data + length;
+
+	// "42" at the start of the message means there's a websocket message event.
+	if (length <= 2 || data[0] != '4' || data[1] != '2') {
+		return MESSAGE_INVALID;
+	}
+	const char* p = skipSpace(data + 2, end);
+	if (p >= end || *p != '[') {
+		return MESSAGE_MANUAL;
+	}
+
+	const char* event;
+	const char* event_end;
+	p = scanString(skipSpace(p + 1, end), end, event, event_end);
+	if (!p) {
+		return MESSAGE_INVALID;
+	}
+	p = skipSpace(p, end);
+	if (p < end && *p == ',') {
+		p = skipSpace(p + 1, end);
+	}
+	if (p >= end || *p != '{') {
+		// No data object, e.g. 42["telemetry",null]
+		return MESSAGE_MANUAL;
+	}
+	if (!keyIs(event, event_end, "telemetry")) {
+		return MESSAGE_OTHER;
+	}
+
+	// Fields missing from this message must not keep the previous message's values
+	telemetry.session_id = 0;
+	telemetry.has_sense = false;
+	telemetry.sense_x = 0;
+	telemetry.sense_y = 0;
+	telemetry.sense_theta = 0;
+	telemetry.has_control = false;
+	telemetry.previous_velocity = 0;
+	telemetry.previous_yawrate = 0;
+	// One bit per field, so a repeated key cannot stand in for a missing one
+	int sense_fields = 0;
+	int control_fields = 0;
+	bool parsed = false;
+	size_t num_x = 0;
+	size_t num_y = 0;
+	telemetry.observations.clear();
+
+	p = skipSpace(p + 1, end);
+	while (p && p < end && *p != '}') {
+		const char* key;
+		const char* key_end;
+		p = scanString(p, end, key, key_end);
+		if (!p) {
+			return MESSAGE_INVALID;
+		}
+		p = skipSpace(p, end);
+		if (p >= end || *p != ':') {
+			return MESSAGE_INVALID;
+		}
+		p = skipSpace(p + 1, end);
+
+		if (keyIs(key, key_end, "session_id")) {
+			double session_id = 0;
+			p = readNumber(p, end, session_id, parsed);
+			// Only whole numbers in int range name a session (NaN fails the floor check)
+			if (p && (!parsed || floor(session_id) != session_id || session_id < INT_MIN || session_id > INT_MAX)) {
+				return MESSAGE_INVALID;
+			}
+			telemetry.session_id = (int)session_id;
+		} else if (keyIs(key, key_end, "sense_x")) {
+			p = readNumber(p, end, telemetry.sense_x, parsed);
+			sense_fields |= parsed ? 1 : 0;
+		} else if (keyIs(key, key_end, "sense_y")) {
+			p = readNumber(p, end, telemetry.sense_y, parsed);
+			sense_fields |= parsed ? 2 : 0;
+		} else if (keyIs(key, key_end, "sense_theta")) {
+			p = readNumber(p, end, telemetry.sense_theta, parsed);
+			sense_fields |= parsed ? 4 : 0;
+		} else if (keyIs(key, key_end, "previous_velocity")) {
+			p = readNumber(p, end, telemetry.previous_velocity, parsed);
+			control_fields |= parsed ? 1 : 0;
+		} else if (keyIs(key, key_end, "previous_yawrate")) {
+			p = readNumber(p, end, telemetry.previous_yawrate, parsed);
+			control_fields |= parsed ? 2 : 0;
+		} else if (keyIs(key, key_end, "sense_observations_x")) {
+			p = readObservations(p, end, telemetry.observations, num_x, true);
+		} else if (keyIs(key, key_end, "sense_observations_y")) {
+			p = readObservations(p, end, telemetry.observations, num_y, false);
+		} else {
+			p = skipValue(p, end);
+		}
+
+		p = p ? skipSpace(p, end) : nullptr;
+		if (p && p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		}
+	}
+	if (!p || p >= end) {
+		return MESSAGE_INVALID;
+	}
+
+	// Only observations with both coordinates are kept
+	telemetry.observations.resize(num_x < num_y ? num_x : num_y);
+	telemetry.has_sense = (sense_fields == 7);
+	telemetry.has_control = (control_fields == 3);
+	return MESSAGE_TELEMETRY;
+}
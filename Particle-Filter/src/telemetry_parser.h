@@ -0,0 +1,59 @@
+/*
+ * telemetry_parser.h
+ *
+ * Single-pass decoder for the simulator's telemetry messages.
+ */
+
+#ifndef TELEMETRY_PARSER_H_
+#define TELEMETRY_PARSER_H_
+
+#include <stddef.h>
+#include <vector>
+#include "helper_functions.h"
+
+/*
+ * Fields of one telemetry event. The simulator sends numbers either as JSON
+ * numbers or as strings; both are accepted. Fields missing from a message are
+ * reset to 0, so check has_sense and has_control before using them.
+ */
+struct Telemetry {
+
+	int session_id;				// Vehicle the event belongs to, 0 if not given
+								// (an id that is not a whole int makes the message invalid)
+
+	bool has_sense;				// sense_x/sense_y/sense_theta were present and numeric
+	double sense_x;				// Noisy GPS x position [m]
+	double sense_y;				// Noisy GPS y position [m]
+	double sense_theta;			// Noisy GPS yaw [rad]
+
+	bool has_control;			// previous_velocity/previous_yawrate were present and numeric
+	double previous_velocity;	// Velocity of the previous step [m/s]
+	double previous_yawrate;	// Yaw rate of the previous step [rad/s]
+
+	// Landmark observations in vehicle coordinates. The buffer is reused between
+	// messages, so it stops allocating once it reached the largest observation count.
+	std::vector<LandmarkObs> observations;
+
+	Telemetry() : session_id(0), has_sense(false), sense_x(0), sense_y(0), sense_theta(0),
+		has_control(false), previous_velocity(0), previous_yawrate(0) {}
+};
+
+enum TelemetryMessage {
+	MESSAGE_INVALID,	// Not a socket.io event or malformed
+	MESSAGE_MANUAL,		// Event without data, the simulator is in manual mode
+	MESSAGE_TELEMETRY,	// Telemetry event, fields decoded
+	MESSAGE_OTHER		// Any other event
+};
+
+/**
+ * parse_telemetry Decodes a socket.io message ("42[event, data]") in one pass,
+ *   writing the telemetry fields straight into telemetry without building a
+ *   document or copying the message.
+ * @param data Message buffer, need not be null-terminated
+ * @param length Length of the message [bytes]
+ * @param telemetry Decoded fields, valid if MESSAGE_TELEMETRY is returned
+ * @output Kind of message
+ */
+TelemetryMessage parse_telemetry(const char* data, size_t length, Telemetry& telemetry);
+
+#endif /* TELEMETRY_PARSER_H_ */
@@ -0,0 +1,312 @@
+/*
+ * tiled_map.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tiled_map.h"
+
+using namespace std;
+
+/*
+ * Header of a tile file. It is followed by the tile directory (tiles_x * tiles_y
+ * entries, row by row) and the landmarks of each tile, every tile starting on a
+ * kTileAlignment boundary so tiles can be paged in and released independently.
+ */
+struct TileFileHeader {
+	char magic[8];
+	double tile_size;
+	double origin_x;
+	double origin_y;
+	int32_t tiles_x;
+	int32_t tiles_y;
+	uint64_t num_landmarks;
+};
+
+static const char kTileMagic[8] = { 'P', 'F', 'T', 'I', 'L', 'E', '1', '\0' };
+static const uint64_t kTileAlignment = 4096;
+
+bool write_tiled_map(const Map& map, double tile_size, const std::string& filename) {
+	const vector<Map::single_landmark_s>& landmarks = map.landmark_list;
+	if (tile_size <= 0) {
+		return false;
+	}
+
+	TileFileHeader header;
+	memcpy(header.magic, kTileMagic, sizeof(kTileMagic));
+	header.tile_size = tile_size;
+	header.origin_x = 0;
+	header.origin_y = 0;
+	double max_x = 0, max_y = 0;
+	for (size_t i = 0; i < landmarks.size(); i++) {
+		if (i == 0 || landmarks[i].x_f < header.origin_x) header.origin_x = landmarks[i].x_f;
+		if (i == 0 || landmarks[i].y_f < header.origin_y) header.origin_y = landmarks[i].y_f;
+		if (i == 0 || landmarks[i].x_f > max_x) max_x = landmarks[i].x_f;
+		if (i == 0 || landmarks[i].y_f > max_y) max_y = landmarks[i].y_f;
+	}
+	header.tiles_x = (int32_t)((max_x - header.origin_x) / tile_size) + 1;
+	header.tiles_y = (int32_t)((max_y - header.origin_y) / tile_size) + 1;
+	header.num_landmarks = landmarks.size();
+	size_t num_tiles = (size_t)header.tiles_x * header.tiles_y;
+
+	// Bucket the landmarks by tile
+	vector<int> tile_of(landmarks.size());
+	vector<uint32_t> counts(num_tiles, 0);
+	for (size_t i = 0; i < landmarks.size(); i++) {
+		int tx = min(header.tiles_x - 1, (int)((landmarks[i].x_f - header.origin_x) / tile_size));
+		int ty = min(header.tiles_y - 1, (int)((landmarks[i].y_f - header.origin_y) / tile_size));
+		tile_of[i] = ty * header.tiles_x + tx;
+		counts[tile_of[i]]++;
+	}
+
+	// Tile offsets, each tile aligned so it owns its pages
+	vector<TileEntry> directory(num_tiles, TileEntry());
+	uint64_t offset = sizeof(header) + directory.size() * sizeof(TileEntry);
+	for (size_t t = 0; t < num_tiles; t++) {
+		if (counts[t] == 0) {
+			continue;
+		}
+		offset = (offset + kTileAlignment - 1) / kTileAlignment * kTileAlignment;
+		directory[t].offset = offset;
+		directory[t].count = counts[t];
+		offset += counts[t] * sizeof(Map::single_landmark_s);
+	}
+
+	vector<Map::single_landmark_s> sorted(landmarks.size());
+	vector<uint64_t> fill(num_tiles, 0);
+	for (size_t t = 1; t < num_tiles; t++) {
+		fill[t] = fill[t - 1] + counts[t - 1];
+	}
+	for (size_t i = 0; i < landmarks.size(); i++) {
+		sorted[fill[tile_of[i]]++] = landmarks[i];
+	}
+
+	FILE* out = fopen(filename.c_str(), "wb");
+	if (!out) {
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+			fwrite(directory.data(), sizeof(TileEntry), directory.size(), out) == directory.size();
+	size_t next = 0;
+	for (size_t t = 0; t < num_tiles && written; t++) {
+		if (counts[t] == 0) {
+			continue;
+		}
+		written = fseek(out, (long)directory[t].offset, SEEK_SET) == 0 &&
+				fwrite(&sorted[next], sizeof(Map::single_landmark_s), counts[t], out) == counts[t];
+		next += counts[t];
+	}
+	written = (fclose(out) == 0) && written;
+	if (!written) {
+		remove(filename.c_str());
+	}
+	return written;
+}
+
+TiledMap::TiledMap() : tile_size(1), origin_x(0), origin_y(0), tiles_x(0), tiles_y(0),
+	fd(-1), data(nullptr), size(0), directory(nullptr), max_resident_tiles(0),
+	last_center_x(0), last_center_y(0), has_last_center(false), index_cell_size(0), stats() {}
+
+TiledMap::~TiledMap() {
+	close();
+}
+
+void TiledMap::close() {
+	if (data) {
+		munmap(const_cast<char*>(data), size);
+	}
+	if (fd >= 0) {
+		::close(fd);
+	}
+	fd = -1;
+	data = nullptr;
+	size = 0;
+	directory = nullptr;
+	lru.clear();
+	required.clear();
+	active_map.landmark_list.clear();
+	active_map.buildIndex();
+	has_last_center = false;
+	stats = TileCacheStats();
+}
+
+bool TiledMap::open(const std::string& filename, size_t max_resident_tiles, double cell_size) {
+	close();
+	this->max_resident_tiles = max_resident_tiles;
+	index_cell_size = cell_size;
+
+	fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TileFileHeader)) {
+		close();
+		return false;
+	}
+	size = st.st_size;
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		size = 0;
+		close();
+		return false;
+	}
+	data = static_cast<const char*>(p);
+	// Nothing is needed up front, pages come in as tiles are required
+	madvise(p, size, MADV_RANDOM);
+
+	TileFileHeader header;
+	memcpy(&header, data, sizeof(header));
+	size_t num_tiles = (size_t)max(header.tiles_x, 0) * max(header.tiles_y, 0);
+	if (memcmp(header.magic, kTileMagic, sizeof(kTileMagic)) != 0 || header.tile_size <= 0 ||
+			size < sizeof(header) + num_tiles * sizeof(TileEntry)) {
+		close();
+		return false;
+	}
+	tile_size = header.tile_size;
+	origin_x = header.origin_x;
+	origin_y = header.origin_y;
+	tiles_x = header.tiles_x;
+	tiles_y = header.tiles_y;
+	directory = reinterpret_cast<const TileEntry*>(data + sizeof(header));
+	for (size_t t = 0; t < num_tiles; t++) {
+		if (directory[t].offset + (uint64_t)directory[t].count * sizeof(Map::single_landmark_s) > size) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+const Map::single_landmark_s* TiledMap::tileLandmarks(int tile) const {
+	return reinterpret_cast<const Map::single_landmark_s*>(data + directory[tile].offset);
+}
+
+void TiledMap::tileRange(double min_x, double min_y, double max_x, double max_y, vector<int>& tiles) const {
+	tiles.clear();
+	int tx0 = max(0, (int)floor((min_x - origin_x) / tile_size));
+	int ty0 = max(0, (int)floor((min_y - origin_y) / tile_size));
+	int tx1 = min(tiles_x - 1, (int)floor((max_x - origin_x) / tile_size));
+	int ty1 = min(tiles_y - 1, (int)floor((max_y - origin_y) / tile_size));
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+			tiles.push_back(ty * tiles_x + tx);
+		}
+	}
+}
+
+// Applies a paging hint to the pages holding a tile
+static void adviseTile(const char* data, uint64_t offset, size_t bytes, int advice) {
+	static const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	if (bytes == 0) {
+		return;
+	}
+	uintptr_t begin = (uintptr_t)(data + offset) & ~(page - 1);
+	uintptr_t end = (uintptr_t)(data + offset + bytes);
+	madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+}
+
+void TiledMap::touch(int tile) {
+	vector<int>::iterator it = find(lru.begin(), lru.end(), tile);
+	if (it != lru.end()) {
+		stats.hits++;
+		lru.erase(it);
+	} else {
+		stats.misses++;
+		adviseTile(data, directory[tile].offset, directory[tile].count * sizeof(Map::single_landmark_s),
+				MADV_WILLNEED);
+	}
+	lru.insert(lru.begin(), tile);
+}
+
+void TiledMap::release(int tile) {
+	stats.evictions++;
+	adviseTile(data, directory[tile].offset, directory[tile].count * sizeof(Map::single_landmark_s),
+			MADV_DONTNEED);
+}
+
+void TiledMap::prefetch(double min_x, double min_y, double max_x, double max_y, double dir_x, double dir_y) {
+	vector<int> ahead;
+	tileRange(min_x + dir_x * tile_size, min_y + dir_y * tile_size,
+			max_x + dir_x * tile_size, max_y + dir_y * tile_size, ahead);
+
+	// Prefetched tiles rank right behind the required ones in the LRU order
+	size_t position = min(next_required.size(), lru.size());
+	for (size_t i = 0; i < ahead.size(); i++) {
+		int tile = ahead[i];
+		if (directory[tile].count == 0 || find(lru.begin(), lru.end(), tile) != lru.end()) {
+			continue;
+		}
+		stats.prefetches++;
+		adviseTile(data, directory[tile].offset, directory[tile].count * sizeof(Map::single_landmark_s),
+				MADV_WILLNEED);
+		lru.insert(lru.begin() + position++, tile);
+	}
+}
+
+void TiledMap::update(const std::vector<Particle>& particles, double margin) {
+	if (!data || particles.empty()) {
+		return;
+	}
+
+	double min_x = particles[0].x, max_x = particles[0].x;
+	double min_y = particles[0].y, max_y = particles[0].y;
+	double center_x = 0, center_y = 0;
+	for (size_t i = 0; i < particles.size(); i++) {
+		min_x = min(min_x, particles[i].x);
+		max_x = max(max_x, particles[i].x);
+		min_y = min(min_y, particles[i].y);
+		max_y = max(max_y, particles[i].y);
+		center_x += particles[i].x;
+		center_y += particles[i].y;
+	}
+	center_x /= particles.size();
+	center_y /= particles.size();
+	min_x -= margin;
+	min_y -= margin;
+	max_x += margin;
+	max_y += margin;
+
+	tileRange(min_x, min_y, max_x, max_y, next_required);
+	// Empty tiles hold nothing to page in
+	next_required.erase(remove_if(next_required.begin(), next_required.end(),
+			[this](int tile) { return directory[tile].count == 0; }), next_required.end());
+	for (size_t i = next_required.size(); i-- > 0;) {
+		touch(next_required[i]);
+	}
+
+	if (has_last_center) {
+		double dx = center_x - last_center_x;
+		double dy = center_y - last_center_y;
+		double moved = sqrt(dx * dx + dy * dy);
+		if (moved > 1e-6) {
+			prefetch(min_x, min_y, max_x, max_y, dx / moved, dy / moved);
+		}
+	}
+	last_center_x = center_x;
+	last_center_y = center_y;
+	has_last_center = true;
+
+	while (lru.size() > max(max_resident_tiles, next_required.size())) {
+		release(lru.back());
+		lru.pop_back();
+	}
+
+	if (next_required != required) {
+		active_map.landmark_list.clear();
+		for (size_t i = 0; i < next_required.size(); i++) {
+			const Map::single_landmark_s* tile = tileLandmarks(next_required[i]);
+			active_map.landmark_list.insert(active_map.landmark_list.end(), tile,
+					tile + directory[next_required[i]].count);
+		}
+		active_map.buildIndex(index_cell_size);
+		required.swap(next_required);
+	}
+
+	stats.resident_tiles = lru.size();
+	stats.active_landmarks = active_map.landmark_list.size();
+}
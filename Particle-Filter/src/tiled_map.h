@@ -0,0 +1,131 @@
+/*
+ * tiled_map.h
+ *
+ * Landmark map split into square tiles stored in one page-aligned file, for
+ * maps too large to hold in memory. Tiles are memory-mapped and only the tiles
+ * around the particle cloud are kept resident.
+ */
+
+#ifndef TILED_MAP_H_
+#define TILED_MAP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "particle_filter.h"
+
+/* Writes a map as a tile file.
+ * @param map Map to split into tiles
+ * @param tile_size Side length of a tile [m]
+ * @param filename Name of the tile file to write
+ * @output True if writing the file was successful
+ */
+bool write_tiled_map(const Map& map, double tile_size, const std::string& filename);
+
+/*
+ * Directory entry of one tile in a tile file.
+ */
+struct TileEntry {
+
+	uint64_t offset;	// Byte offset of the tile's landmarks in the file
+	uint32_t count;		// Number of landmarks in the tile
+	uint32_t reserved;
+};
+
+/*
+ * Counters describing how the tile cache behaved so far.
+ */
+struct TileCacheStats {
+
+	uint64_t hits;			// Required tiles that were already resident
+	uint64_t misses;		// Required tiles that had to be paged in
+	uint64_t evictions;		// Tiles released to make room
+	uint64_t prefetches;	// Tiles ahead of the vehicle requested in advance
+	size_t resident_tiles;	// Tiles currently resident
+	size_t active_landmarks;	// Landmarks in the active map
+};
+
+class TiledMap {
+
+	// Tile grid read from the file header
+	double tile_size;
+	double origin_x;
+	double origin_y;
+	int tiles_x;
+	int tiles_y;
+
+	// Memory mapping of the tile file
+	int fd;
+	const char* data;
+	size_t size;
+	const TileEntry* directory;
+
+	// Resident tiles, most recently used first
+	std::vector<int> lru;
+	size_t max_resident_tiles;
+
+	// Tiles the active map is built from, sorted
+	std::vector<int> required;
+	std::vector<int> next_required;
+
+	// Cloud centre at the last update, for the direction of travel
+	double last_center_x;
+	double last_center_y;
+	bool has_last_center;
+
+	// Landmarks of the required tiles and their spatial index
+	Map active_map;
+	double index_cell_size;
+
+	TileCacheStats stats;
+
+	const Map::single_landmark_s* tileLandmarks(int tile) const;
+	void tileRange(double min_x, double min_y, double max_x, double max_y, std::vector<int>& tiles) const;
+	void touch(int tile);
+	void prefetch(double min_x, double min_y, double max_x, double max_y, double dir_x, double dir_y);
+	void release(int tile);
+	void close();
+
+	TiledMap(const TiledMap&);
+	TiledMap& operator=(const TiledMap&);
+
+public:
+
+	TiledMap();
+	~TiledMap();
+
+	/**
+	 * open Maps a tile file written by write_tiled_map.
+	 * @param filename Name of the tile file
+	 * @param max_resident_tiles Number of tiles kept paged in. Tiles covering the
+	 *   particle cloud are always resident, even if there are more of them.
+	 * @param cell_size Spatial index cell size of the active map [m], chosen from the
+	 *   landmark density if <= 0
+	 * @output True if the file was opened and is a valid tile file
+	 */
+	bool open(const std::string& filename, size_t max_resident_tiles, double cell_size = 0);
+
+	/**
+	 * update Makes the tiles within margin of the particle cloud resident, rebuilds
+	 *   the active map if they changed and prefetches the tiles ahead in the
+	 *   direction the cloud moved since the last update.
+	 * @param particles Current particle set
+	 * @param margin Distance [m] around the cloud that must be covered, usually the sensor range
+	 */
+	void update(const std::vector<Particle>& particles, double margin);
+
+	/**
+	 * activeMap Landmarks of the tiles around the particle cloud with their spatial index,
+	 *   to pass to ParticleFilter::updateWeights.
+	 */
+	const Map& activeMap() const {
+		return active_map;
+	}
+
+	const TileCacheStats& cacheStats() const {
+		return stats;
+	}
+};
+
+#endif /* TILED_MAP_H_ */